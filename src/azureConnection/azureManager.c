@@ -6,11 +6,17 @@
 #include <net/azure_iot_hub.h>
 #include <net/azure_iot_hub_dps.h>
 #include <zephyr/logging/log.h>
+#include <zephyr/random/random.h>
+#include <modem/lte_lc.h>
 #include <cJSON.h>
 #include <cJSON_os.h>
+#include <date_time.h>
+#include <time.h>
 
 #include "azureManager.h"
 #include "deviceReboot.h"
+#include "telemetry/bootTimeline.h"
+#include "telemetry/telemetryStore.h"
 
 LOG_MODULE_REGISTER(azureManager, LOG_LEVEL_DBG);
 
@@ -18,8 +24,6 @@ LOG_MODULE_REGISTER(azureManager, LOG_LEVEL_DBG);
 #define RECV_BUF_SIZE		1024
 #define APP_WORK_Q_STACK_SIZE	KB(8)
 
-#define MAX_CONNECTION_RETRY 20
-
 static struct method_data 
 {
 	struct k_work work;
@@ -28,10 +32,83 @@ static struct method_data
 	char payload[200];
 } method_data;
 
+static struct direct_method_entry
+{
+	const char *name;
+	azureDirectMethodHandlerCb handler;
+} direct_methods[AZURE_MANAGER_MAX_DIRECT_METHODS];
+static char method_response[AZURE_MANAGER_METHOD_RESPONSE_SIZE];
+
 azureEventHandlerCb azureManagerHandler;
 deviceTwinHandlerCb dTHandler;
 
 static struct k_work_delayable reboot_work;
+static struct k_work_delayable store_drain_work;
+
+static bool hubConnected;
+static char drain_buf[AZURE_MANAGER_TELEMETRY_MAX_SIZE];
+static atomic_t drain_in_flight; //A stored message is queued or waiting for its PUBACK, it is still in the store
+static uint16_t drain_sent; //Stored messages delivered since the last pause
+
+//Message waiting in the outbound queue, the payload is copied so the caller's buffer can be reused at once
+struct outbound_msg
+{
+	int64_t enqueue_time;
+	int64_t timestamp_ms;
+	enum azure_iot_hub_topic_type topic;
+	azureManagerSendCompleteCb complete_cb;
+	void *user_data;
+	uint16_t len;
+	char payload[AZURE_MANAGER_TELEMETRY_MAX_SIZE];
+};
+
+//QoS 1 message waiting for its PUBACK, it is kept so it can be sent again after a reconnect
+struct inflight_msg
+{
+	bool used;
+	uint16_t message_id;
+	azureManagerPriority priority;
+	struct outbound_msg msg;
+};
+
+K_MSGQ_DEFINE(outbound_alarm_msgq, sizeof(struct outbound_msg), AZURE_MANAGER_QUEUE_DEPTH_ALARM, 8);
+K_MSGQ_DEFINE(outbound_twin_msgq, sizeof(struct outbound_msg), AZURE_MANAGER_QUEUE_DEPTH_TWIN_REPORT, 8);
+K_MSGQ_DEFINE(outbound_periodic_msgq, sizeof(struct outbound_msg), AZURE_MANAGER_QUEUE_DEPTH_PERIODIC, 8);
+
+static struct k_msgq *const outbound_msgq[AZURE_MNG_PRIORITY_COUNT] = 
+{
+	[AZURE_MNG_PRIORITY_ALARM] = &outbound_alarm_msgq,
+	[AZURE_MNG_PRIORITY_TWIN_REPORT] = &outbound_twin_msgq,
+	[AZURE_MNG_PRIORITY_PERIODIC] = &outbound_periodic_msgq,
+};
+
+//Counts the messages in all outbound queues, the sender thread waits on this
+static K_SEM_DEFINE(outbound_sem, 0, K_SEM_MAX_LIMIT);
+static K_MUTEX_DEFINE(outbound_mutex);
+static struct outbound_msg enqueue_msg;
+static struct outbound_msg sender_msg;
+
+//The statistics are updated from the sender thread, the work queue and the callers of the send functions
+static struct k_spinlock stats_lock;
+static azureManagerQueueStats queue_stats[AZURE_MNG_PRIORITY_COUNT];
+static uint64_t latency_total_ms[AZURE_MNG_PRIORITY_COUNT];
+static uint64_t ack_latency_total_ms[AZURE_MNG_PRIORITY_COUNT];
+
+static const enum mqtt_qos outbound_qos[AZURE_MNG_PRIORITY_COUNT] = 
+{
+	[AZURE_MNG_PRIORITY_ALARM] = AZURE_MANAGER_QOS_ALARM,
+	[AZURE_MNG_PRIORITY_TWIN_REPORT] = AZURE_MANAGER_QOS_TWIN_REPORT,
+	[AZURE_MNG_PRIORITY_PERIODIC] = AZURE_MANAGER_QOS_PERIODIC,
+};
+
+static struct inflight_msg inflight[AZURE_MANAGER_INFLIGHT_WINDOW];
+static K_SEM_DEFINE(inflight_free_sem, AZURE_MANAGER_INFLIGHT_WINDOW, AZURE_MANAGER_INFLIGHT_WINDOW);
+static K_MUTEX_DEFINE(inflight_mutex);
+static atomic_t retransmit_pending;
+static uint16_t next_message_id = 1;
+
+static void sender_thread_fn(void);
+K_THREAD_DEFINE(azure_sender_thread, AZURE_MANAGER_SENDER_STACK_SIZE, sender_thread_fn, NULL, NULL, NULL, AZURE_MANAGER_SENDER_PRIORITY, 0, 0);
 
 uint8_t *desiredObjectName;
 
@@ -42,9 +119,30 @@ static atomic_t event_interval = EVENT_INTERVAL;
 
 static uint16_t connectionRetires;
 
+//States of the connection supervisor
+enum connection_state
+{
+	CONNECTION_IDLE,
+	CONNECTION_BACKOFF,
+	CONNECTION_CONNECTING,
+	CONNECTION_CONNECTED
+};
+
+static atomic_t connection_state = ATOMIC_INIT(CONNECTION_IDLE);
+static atomic_t network_connected; //Attempts can't reach the hub without the network, so they aren't counted
+static uint16_t connect_attempts; //Failed attempts in a row, reset when the hub connection is established
+static atomic_t modem_reset_pending; //Set once per AZURE_MANAGER_MODEM_RESET_ATTEMPTS failures, not again on the same count
+static struct k_work_delayable connect_work;
+
 static bool dps_was_successful;
 static K_SEM_DEFINE(dps_done_sem, 0, 1);
 
+//The DPS library stores the hub assignment, so after the first boot DPS is only run again
+//when the assigned hub rejected the device or re-provisioning was requested
+static bool dps_required = true;
+static bool using_stored_assignment;
+static int64_t first_publish_time = -EAGAIN;
+
 static K_THREAD_STACK_DEFINE(application_stack_area, APP_WORK_Q_STACK_SIZE);
 static struct k_work_q application_work_q;
 
@@ -169,6 +267,11 @@ static void event_interval_apply(int interval)
 	atomic_set(&event_interval, interval);
 }
 
+static void inflight_complete(uint16_t message_id);
+static void connection_retry_schedule(void);
+static void hub_assignment_reset(void);
+static int dps_run(struct azure_iot_hub_buf *hostname, struct azure_iot_hub_buf *device_id_in);
+
 static void azure_event_handler(struct azure_iot_hub_evt *const evt)
 {
 	azureManagerEvent ev;
@@ -178,16 +281,22 @@ static void azure_event_handler(struct azure_iot_hub_evt *const evt)
 	case AZURE_IOT_HUB_EVT_CONNECTING:
 		connectionRetires++;
 		LOG_INF("AZURE_IOT_HUB_EVT_CONNECTING (retry %d)", connectionRetires);
-		if(connectionRetires > MAX_CONNECTION_RETRY)
-		{
-			LOG_ERR("Max connection retries reached, rebooting device");
-			DeviceRebootError();
-		}	
 		break;
 
 	case AZURE_IOT_HUB_EVT_CONNECTED:
 		connectionRetires = 0;
+		connect_attempts = 0;
+		atomic_set(&connection_state, CONNECTION_CONNECTED);
+		hubConnected = true;
 		LOG_INF("AZURE_IOT_HUB_EVT_CONNECTED");
+		BootTimelineMark(BOOT_STAGE_HUB_CONNECTED);
+
+		//Send the QoS 1 messages that weren't acknowledged before the connection was lost
+		atomic_set(&retransmit_pending, 1);
+		k_sem_give(&outbound_sem);
+
+		//Send the messages stored while the device was offline
+		k_work_schedule_for_queue(&application_work_q, &store_drain_work, K_NO_WAIT);
 		if (azureManagerHandler != NULL)
 		{
 			ev.event=AZURE_MNG_NETWORK_CONNECTED;
@@ -198,10 +307,19 @@ static void azure_event_handler(struct azure_iot_hub_evt *const evt)
 	case AZURE_IOT_HUB_EVT_CONNECTION_FAILED:
 		LOG_INF("AZURE_IOT_HUB_EVT_CONNECTION_FAILED");
 		LOG_INF("Error code received from IoT Hub: %d", evt->data.err);
+		if (using_stored_assignment && (evt->data.err == MQTT_IDENTIFIER_REJECTED || 
+			evt->data.err == MQTT_BAD_USER_NAME_OR_PASSWD || evt->data.err == MQTT_NOT_AUTHORIZED))
+		{
+			LOG_WRN("The assigned IoT hub rejected the device, running DPS on the next attempt");
+			hub_assignment_reset();
+		}
+		connection_retry_schedule();
 	break;
 
 	case AZURE_IOT_HUB_EVT_DISCONNECTED:
+		hubConnected = false;
 		LOG_INF("AZURE_IOT_HUB_EVT_DISCONNECTED");
+		connection_retry_schedule();
 		if (azureManagerHandler != NULL)
 		{
 			ev.event=AZURE_MNG_NETWORK_DISCONNECTED;
@@ -249,7 +367,8 @@ static void azure_event_handler(struct azure_iot_hub_evt *const evt)
 	break;
 
 	case AZURE_IOT_HUB_EVT_PUBACK:
-		LOG_INF("AZURE_IOT_HUB_EVT_PUBACK");
+		LOG_INF("AZURE_IOT_HUB_EVT_PUBACK, ID: %d", evt->data.message_id);
+		inflight_complete(evt->data.message_id);
 	break;
 
 	case AZURE_IOT_HUB_EVT_FOTA_START:
@@ -286,6 +405,41 @@ static void azure_event_handler(struct azure_iot_hub_evt *const evt)
 
 //ToDo this handler should instead be a external module which is up to the different applications to implement
 //See device twin application for inspiration
+//Runs a method registered by another module and sends its response
+static void direct_method_dispatch(struct azure_iot_hub_result *result)
+{
+	int status;
+	int err;
+
+	result->status = 404;
+	result->payload.ptr = NULL;
+	result->payload.size = 0;
+
+	for (int i = 0; i < ARRAY_SIZE(direct_methods); i++)
+	{
+		if (direct_methods[i].name != NULL && strcmp(method_data.name, direct_methods[i].name) == 0)
+		{
+			method_response[0] = '\0';
+			status = direct_methods[i].handler(method_data.payload, method_response, sizeof(method_response));
+			result->status = status < 0 ? 500 : status;
+			result->payload.ptr = method_response;
+			result->payload.size = strlen(method_response);
+			break;
+		}
+	}
+
+	if (result->status == 404)
+	{
+		LOG_WRN("Unknown direct method: %s", method_data.name);
+	}
+
+	err = azure_iot_hub_method_respond(result);
+	if (err) 
+	{
+		LOG_ERR("Failed to send direct method response");
+	}
+}
+
 static void direct_method_handler(struct k_work *work)
 {
 	int err;
@@ -310,6 +464,22 @@ static void direct_method_handler(struct k_work *work)
 		LOG_INF("Rebooting device");
 		k_work_schedule(&reboot_work, K_SECONDS(1));
 	}
+	else if (strcmp(method_data.name, "Reprovision") == 0) 
+	{
+		//The response is sent before disconnecting, DPS is run by the connection supervisor on the reconnect
+		LOG_INF("Re-provisioning device");
+		err = azure_iot_hub_method_respond(&result);
+		if (err) 
+		{
+			LOG_ERR("Failed to send direct method response");
+		}
+		hub_assignment_reset();
+		(void)azure_iot_hub_disconnect();
+	}
+	else
+	{
+		direct_method_dispatch(&result);
+	}
 
 	//From here is the handling of a direct method. This is not currently used anywhere in this manager!
 	//Below is the commented original example provided with the azure_iot_hub example
@@ -330,6 +500,26 @@ static void direct_method_handler(struct k_work *work)
 */
 }
 
+int AzureManagerRegisterDirectMethod(const char *name, azureDirectMethodHandlerCb handler)
+{
+	if (name == NULL || handler == NULL)
+	{
+		return -EINVAL;
+	}
+
+	for (int i = 0; i < ARRAY_SIZE(direct_methods); i++)
+	{
+		if (direct_methods[i].name == NULL)
+		{
+			direct_methods[i].name = name;
+			direct_methods[i].handler = handler;
+			return 0;
+		}
+	}
+	LOG_ERR("No room for direct method %s", name);
+	return -ENOMEM;
+}
+
 int checkAndAssignJsonObjectInt(struct cJSON *jsonObj, struct cJSON *jsonObjRoot)
 {
 	int value;
@@ -357,10 +547,576 @@ int checkAndAssignJsonObjectInt(struct cJSON *jsonObj, struct cJSON *jsonObjRoot
 }
 
 
+//Format a unix timestamp in milliseconds as an ISO 8601 UTC string
+static int format_creation_time(char *buf, size_t buf_size, int64_t timestamp_ms)
+{
+	time_t raw_time = timestamp_ms / 1000;
+	struct tm time;
+
+	if (gmtime_r(&raw_time, &time) == NULL)
+	{
+		return -EINVAL;
+	}
+
+	return snprintf(buf, buf_size, "%04d-%02d-%02dT%02d:%02d:%02d.%03dZ", time.tm_year + 1900, time.tm_mon + 1,
+		time.tm_mday, time.tm_hour, time.tm_min, time.tm_sec, (int)(timestamp_ms % 1000));
+}
+
+//Publish a message, telemetry gets the creation time as a message property so stored messages keep their original time
+static int send_outbound_message(struct outbound_msg *outbound, enum mqtt_qos qos, uint16_t message_id, bool dup)
+{
+	char creation_time[32];
+	struct azure_iot_hub_property properties[] = 
+	{
+		{
+			.key.ptr = "iothub-creation-time-utc",
+			.key.size = sizeof("iothub-creation-time-utc") - 1,
+			.value.ptr = creation_time,
+		},
+	};
+	struct azure_iot_hub_msg msg = 
+	{
+		.topic.type = outbound->topic,
+		.payload.ptr = outbound->payload,
+		.payload.size = outbound->len,
+		.qos = qos,
+		.message_id = message_id,
+		.dup_flag = dup,
+	};
+	int len_time = -1;
+
+	if (outbound->topic == AZURE_IOT_HUB_TOPIC_EVENT && outbound->timestamp_ms > 0)
+	{
+		len_time = format_creation_time(creation_time, sizeof(creation_time), outbound->timestamp_ms);
+	}
+
+	if (len_time > 0)
+	{
+		properties[0].value.size = len_time;
+		msg.topic.properties = properties;
+		msg.topic.property_count = ARRAY_SIZE(properties);
+	}
+
+	return azure_iot_hub_send(&msg);
+}
+
+//Send all in-flight QoS 1 messages again with the dup flag set, used after a reconnect or a PUBACK timeout
+static void inflight_retransmit(void)
+{
+	k_spinlock_key_t key;
+	int err;
+
+	k_mutex_lock(&inflight_mutex, K_FOREVER);
+
+	for (int i = 0; i < ARRAY_SIZE(inflight); i++)
+	{
+		if (!inflight[i].used)
+		{
+			continue;
+		}
+
+		err = send_outbound_message(&inflight[i].msg, MQTT_QOS_1_AT_LEAST_ONCE, inflight[i].message_id, true);
+		if (err)
+		{
+			LOG_ERR("Failed to retransmit message %d, error: %d", inflight[i].message_id, err);
+			continue;
+		}
+
+		key = k_spin_lock(&stats_lock);
+		queue_stats[inflight[i].priority].retransmitted++;
+		k_spin_unlock(&stats_lock, key);
+		LOG_INF("Message %d retransmitted", inflight[i].message_id);
+	}
+
+	k_mutex_unlock(&inflight_mutex);
+}
+
+//Take a free slot in the in-flight window, waits while the window is full
+//Returns NULL if the connection is lost while waiting
+static struct inflight_msg *inflight_acquire(void)
+{
+	struct inflight_msg *slot = NULL;
+
+	while (k_sem_take(&inflight_free_sem, K_SECONDS(AZURE_MANAGER_PUBACK_TIMEOUT_S)) != 0)
+	{
+		if (!hubConnected)
+		{
+			return NULL;
+		}
+
+		LOG_WRN("No PUBACK within %d s, retransmitting in-flight messages", AZURE_MANAGER_PUBACK_TIMEOUT_S);
+		inflight_retransmit();
+	}
+
+	k_mutex_lock(&inflight_mutex, K_FOREVER);
+
+	for (int i = 0; i < ARRAY_SIZE(inflight); i++)
+	{
+		if (!inflight[i].used)
+		{
+			slot = &inflight[i];
+			slot->used = true;
+
+			//Message id 0 isn't allowed by MQTT
+			slot->message_id = next_message_id++;
+			if (next_message_id == 0)
+			{
+				next_message_id = 1;
+			}
+			break;
+		}
+	}
+
+	k_mutex_unlock(&inflight_mutex);
+	return slot;
+}
+
+static void inflight_release(struct inflight_msg *slot)
+{
+	k_mutex_lock(&inflight_mutex, K_FOREVER);
+	slot->used = false;
+	k_mutex_unlock(&inflight_mutex);
+
+	k_sem_give(&inflight_free_sem);
+}
+
+//Called on PUBACK, frees the in-flight slot of the message and calls its completion callback
+static void inflight_complete(uint16_t message_id)
+{
+	azureManagerSendCompleteCb complete_cb = NULL;
+	void *user_data = NULL;
+	azureManagerQueueStats *stats;
+	struct inflight_msg *slot = NULL;
+	k_spinlock_key_t key;
+	uint32_t latency_ms;
+
+	k_mutex_lock(&inflight_mutex, K_FOREVER);
+
+	for (int i = 0; i < ARRAY_SIZE(inflight); i++)
+	{
+		if (inflight[i].used && inflight[i].message_id == message_id)
+		{
+			slot = &inflight[i];
+			break;
+		}
+	}
+
+	if (slot == NULL)
+	{
+		k_mutex_unlock(&inflight_mutex);
+		LOG_DBG("PUBACK for unknown message %d", message_id);
+		return;
+	}
+
+	stats = &queue_stats[slot->priority];
+	latency_ms = (uint32_t)(k_uptime_get() - slot->msg.enqueue_time);
+	key = k_spin_lock(&stats_lock);
+	stats->acked++;
+	ack_latency_total_ms[slot->priority] += latency_ms;
+	stats->ackLatencyAvgMs = ack_latency_total_ms[slot->priority] / stats->acked;
+	stats->ackLatencyMaxMs = MAX(stats->ackLatencyMaxMs, latency_ms);
+	k_spin_unlock(&stats_lock, key);
+
+	complete_cb = slot->msg.complete_cb;
+	user_data = slot->msg.user_data;
+
+	k_mutex_unlock(&inflight_mutex);
+
+	LOG_INF("Message %d acknowledged (priority %d, latency %d ms)", message_id, slot->priority, latency_ms);
+	inflight_release(slot);
+
+	if (complete_cb != NULL)
+	{
+		(*complete_cb)(message_id, 0, user_data);
+	}
+}
+
+//Copy a message into the outbound queue of the given priority and wake up the sender thread
+static int enqueue_message(const char *payload, size_t len, int64_t timestamp_ms, enum azure_iot_hub_topic_type topic, azureManagerPriority priority,
+	azureManagerSendCompleteCb complete_cb, void *user_data)
+{
+	azureManagerQueueStats *stats = &queue_stats[priority];
+	k_spinlock_key_t key;
+	int err;
+
+	if (len > sizeof(enqueue_msg.payload))
+	{
+		LOG_ERR("Message of %d bytes is too large for the outbound queue", len);
+		return -EMSGSIZE;
+	}
+
+	k_mutex_lock(&outbound_mutex, K_FOREVER);
+
+	enqueue_msg.enqueue_time = k_uptime_get();
+	enqueue_msg.timestamp_ms = timestamp_ms;
+	enqueue_msg.topic = topic;
+	enqueue_msg.complete_cb = complete_cb;
+	enqueue_msg.user_data = user_data;
+	enqueue_msg.len = len;
+	memcpy(enqueue_msg.payload, payload, len);
+
+	err = k_msgq_put(outbound_msgq[priority], &enqueue_msg, K_NO_WAIT);
+	if (err == 0)
+	{
+		key = k_spin_lock(&stats_lock);
+		stats->depth = k_msgq_num_used_get(outbound_msgq[priority]);
+		stats->maxDepth = MAX(stats->maxDepth, stats->depth);
+		k_spin_unlock(&stats_lock, key);
+		k_sem_give(&outbound_sem);
+	}
+
+	k_mutex_unlock(&outbound_mutex);
+	return err;
+}
+
+//Called when a stored message is done, it is only removed from the store when it has been delivered
+//(PUBACK for QoS 1). The next message is sent right away, with a pause after each batch to limit the rate
+static void store_drain_complete(uint16_t message_id, int result, void *user_data)
+{
+	uint32_t delay_ms = 0;
+
+	if (result == 0)
+	{
+		TelemetryStorePop();
+		drain_sent++;
+		if (drain_sent % AZURE_MANAGER_DRAIN_BATCH_SIZE == 0)
+		{
+			LOG_INF("%d stored messages pending", TelemetryStoreCount());
+			delay_ms = AZURE_MANAGER_DRAIN_INTERVAL_MS;
+		}
+	}
+	else
+	{
+		LOG_INF("Stored message not sent (error: %d), it is kept in the store", result);
+		delay_ms = AZURE_MANAGER_DRAIN_INTERVAL_MS;
+	}
+
+	atomic_clear(&drain_in_flight);
+	if (hubConnected)
+	{
+		k_work_schedule_for_queue(&application_work_q, &store_drain_work, K_MSEC(delay_ms));
+	}
+}
+
+//Drains the telemetry store one message at a time, with the priority the message was stored with.
+//Stored alarms are sent on the alarm queue so they keep the QoS of alarms
+static void store_drain_work_fn(struct k_work *work)
+{
+	azureManagerPriority priority;
+	uint8_t stored_priority;
+	int64_t timestamp_ms;
+	int len;
+	int err;
+
+	//While a stored message is in flight its completion continues the drain
+	if (!hubConnected || !atomic_cas(&drain_in_flight, 0, 1))
+	{
+		return;
+	}
+
+	do
+	{
+		//Messages that don't fit in the buffer are skipped by the store
+		len = TelemetryStorePeek(drain_buf, sizeof(drain_buf), &timestamp_ms, &stored_priority);
+	} while (len == -EMSGSIZE);
+
+	if (len < 0)
+	{
+		atomic_clear(&drain_in_flight);
+		if (len == -ENOENT)
+		{
+			LOG_INF("All stored telemetry has been sent");
+			return;
+		}
+		LOG_ERR("Could not read stored telemetry, error: %d", len);
+		k_work_schedule_for_queue(&application_work_q, &store_drain_work, K_MSEC(AZURE_MANAGER_DRAIN_INTERVAL_MS));
+		return;
+	}
+
+	priority = stored_priority == AZURE_MNG_PRIORITY_ALARM ? AZURE_MNG_PRIORITY_ALARM : AZURE_MNG_PRIORITY_PERIODIC;
+
+	err = enqueue_message(drain_buf, len, timestamp_ms, AZURE_IOT_HUB_TOPIC_EVENT, priority, store_drain_complete, NULL);
+	if (err)
+	{
+		//The queue is full, try again after the pause
+		atomic_clear(&drain_in_flight);
+		k_work_schedule_for_queue(&application_work_q, &store_drain_work, K_MSEC(AZURE_MANAGER_DRAIN_INTERVAL_MS));
+	}
+}
+
+//Publish one message taken from the outbound queue, telemetry that can't be sent is stored in flash
+static void publish_outbound_message(struct outbound_msg *msg, azureManagerPriority priority)
+{
+	azureManagerQueueStats *stats = &queue_stats[priority];
+	enum mqtt_qos qos = outbound_qos[priority];
+	struct inflight_msg *slot = NULL;
+	k_spinlock_key_t key;
+	uint32_t latency_ms;
+	int err = -ENOTCONN;
+
+	if (hubConnected)
+	{
+		if (qos == MQTT_QOS_1_AT_LEAST_ONCE)
+		{
+			//The message is copied to the in-flight window before it is sent, the PUBACK can arrive before azure_iot_hub_send returns
+			slot = inflight_acquire();
+			if (slot != NULL)
+			{
+				slot->priority = priority;
+				slot->msg = *msg;
+				err = send_outbound_message(&slot->msg, qos, slot->message_id, false);
+				if (err)
+				{
+					inflight_release(slot);
+				}
+			}
+		}
+		else
+		{
+			err = send_outbound_message(msg, qos, 0, false);
+		}
+	}
+
+	if (err == 0)
+	{
+		latency_ms = (uint32_t)(k_uptime_get() - msg->enqueue_time);
+		key = k_spin_lock(&stats_lock);
+		stats->sent++;
+		latency_total_ms[priority] += latency_ms;
+		stats->latencyAvgMs = latency_total_ms[priority] / stats->sent;
+		stats->latencyMaxMs = MAX(stats->latencyMaxMs, latency_ms);
+		k_spin_unlock(&stats_lock, key);
+		LOG_INF("Message sent (priority %d, latency %d ms)", priority, latency_ms);
+
+		if (first_publish_time < 0)
+		{
+			first_publish_time = k_uptime_get();
+			BootTimelineMark(BOOT_STAGE_FIRST_PUBLISH);
+			LOG_INF("Time to first publish: %lld ms (%s)", first_publish_time, using_stored_assignment ? "stored hub assignment" : "DPS");
+		}
+
+		//QoS 1 messages are completed when the PUBACK is received
+		if (slot == NULL && msg->complete_cb != NULL)
+		{
+			(*msg->complete_cb)(0, 0, msg->user_data);
+		}
+		return;
+	}
+
+	//Twin reports are created again on the next twin update, so only telemetry is stored.
+	//A message taken from the store is still in it, its completion keeps it there
+	if (msg->complete_cb == store_drain_complete)
+	{
+		LOG_INF("Stored message not sent (priority %d), error: %d", priority, err);
+	}
+	else if (msg->topic == AZURE_IOT_HUB_TOPIC_EVENT && TelemetryStoreAppend(msg->payload, msg->len, msg->timestamp_ms, priority) == 0)
+	{
+		key = k_spin_lock(&stats_lock);
+		stats->stored++;
+		k_spin_unlock(&stats_lock, key);
+		err = -ENOTCONN;
+		LOG_INF("Azure is not connected, telemetry stored (%d messages pending)", TelemetryStoreCount());
+	}
+	else
+	{
+		key = k_spin_lock(&stats_lock);
+		stats->dropped++;
+		k_spin_unlock(&stats_lock, key);
+		LOG_ERR("Failed to send message (priority %d), error: %d", priority, err);
+	}
+
+	if (msg->complete_cb != NULL)
+	{
+		(*msg->complete_cb)(0, err, msg->user_data);
+	}
+}
+
+//Sender thread, publishes the queued messages with the alarm queue first and the periodic queue last
+static void sender_thread_fn(void)
+{
+	azureManagerPriority priority;
+	k_spinlock_key_t key;
+
+	while (1)
+	{
+		k_sem_take(&outbound_sem, K_FOREVER);
+
+		if (atomic_cas(&retransmit_pending, 1, 0))
+		{
+			inflight_retransmit();
+		}
+
+		for (priority = 0; priority < AZURE_MNG_PRIORITY_COUNT; priority++)
+		{
+			if (k_msgq_get(outbound_msgq[priority], &sender_msg, K_NO_WAIT) == 0)
+			{
+				break;
+			}
+		}
+
+		if (priority == AZURE_MNG_PRIORITY_COUNT)
+		{
+			continue;
+		}
+
+		key = k_spin_lock(&stats_lock);
+		queue_stats[priority].depth = k_msgq_num_used_get(outbound_msgq[priority]);
+		k_spin_unlock(&stats_lock, key);
+		publish_outbound_message(&sender_msg, priority);
+	}
+}
+
+//Erase the assignment stored by the DPS library, the next connect attempt registers with DPS again
+static void hub_assignment_reset(void)
+{
+	int err;
+
+	err = azure_iot_hub_dps_reset();
+	if (err)
+	{
+		LOG_ERR("azure_iot_hub_dps_reset failed, error: %d", err);
+	}
+	using_stored_assignment = false;
+	dps_required = true;
+}
+
+//Get the hub assignment through the DPS library, which only contacts DPS when it has no stored assignment.
+//Called from the connection supervisor so the caller isn't blocked
+static int hub_assignment_provision(void)
+{
+	int err;
+
+	cfg.hostname.size = sizeof(hostname);
+	cfg.device_id.size = sizeof(device_id);
+
+	err = dps_run(&cfg.hostname, &cfg.device_id);
+	if (err)
+	{
+		return err;
+	}
+
+	hostname[MIN(cfg.hostname.size, sizeof(hostname) - 1)] = '\0';
+	device_id[MIN(cfg.device_id.size, sizeof(device_id) - 1)] = '\0';
+	dps_required = false;
+	return 0;
+}
+
+//Delay before the next connect attempt: capped exponential backoff with random jitter in the upper half,
+//so devices that lost the hub at the same time don't reconnect in lockstep
+static uint32_t connection_backoff_ms(uint16_t attempts)
+{
+	uint32_t delay_s = AZURE_MANAGER_BACKOFF_BASE_S;
+	uint32_t delay_ms;
+
+	for (uint16_t i = 1; i < attempts && delay_s < AZURE_MANAGER_BACKOFF_MAX_S; i++)
+	{
+		delay_s *= 2;
+	}
+	delay_ms = MIN(delay_s, AZURE_MANAGER_BACKOFF_MAX_S) * MSEC_PER_SEC;
+
+	return delay_ms / 2 + sys_rand32_get() % (delay_ms / 2 + 1);
+}
+
+//Called when a connect attempt failed or the connection was lost, escalates when the hub stays unreachable
+static void connection_retry_schedule(void)
+{
+	uint32_t delay_ms;
+
+	//A disconnect requested through AzureManagerDisconnect isn't retried, and a failed connect
+	//followed by a disconnect event only counts as one attempt
+	if (atomic_get(&connection_state) == CONNECTION_IDLE || atomic_get(&connection_state) == CONNECTION_BACKOFF)
+	{
+		return;
+	}
+
+	if (!atomic_get(&network_connected))
+	{
+		//Paused until AzureManagerConnect is called when the network is back
+		atomic_set(&connection_state, CONNECTION_BACKOFF);
+		LOG_INF("Network is down, connection attempts paused");
+		return;
+	}
+
+	connect_attempts++;
+
+	if (AZURE_MANAGER_MODEM_RESET_ATTEMPTS > 0 && connect_attempts % AZURE_MANAGER_MODEM_RESET_ATTEMPTS == 0)
+	{
+		atomic_set(&modem_reset_pending, 1);
+	}
+
+	if (AZURE_MANAGER_REBOOT_ATTEMPTS > 0 && connect_attempts >= AZURE_MANAGER_REBOOT_ATTEMPTS)
+	{
+		LOG_ERR("%d connection attempts failed, rebooting device", connect_attempts);
+		DeviceRebootError();
+		return;
+	}
+
+	delay_ms = connection_backoff_ms(connect_attempts);
+	atomic_set(&connection_state, CONNECTION_BACKOFF);
+	k_work_reschedule_for_queue(&application_work_q, &connect_work, K_MSEC(delay_ms));
+
+	LOG_INF("Connection attempt %d failed, retrying in %d ms", connect_attempts, delay_ms);
+}
+
+//Runs on the application work queue, so the caller of AzureManagerConnect is never blocked
+static void connect_work_fn(struct k_work *work)
+{
+	int err;
+
+	if (atomic_get(&connection_state) != CONNECTION_BACKOFF || !atomic_get(&network_connected))
+	{
+		return;
+	}
+
+	if (atomic_cas(&modem_reset_pending, 1, 0))
+	{
+		//The reset takes the network down, the supervisor is paused until it is back. The retry is a
+		//fallback in case the network status doesn't change
+		LOG_WRN("%d connection attempts failed, resetting the modem", connect_attempts);
+		(void)lte_lc_offline();
+		(void)lte_lc_normal();
+		k_work_reschedule_for_queue(&application_work_q, &connect_work, K_MSEC(connection_backoff_ms(connect_attempts)));
+		return;
+	}
+
+	if (dps_required)
+	{
+		err = hub_assignment_provision();
+		if (err)
+		{
+			LOG_ERR("Failed to run DPS, error: %d", err);
+			atomic_set(&connection_state, CONNECTION_CONNECTING);
+			connection_retry_schedule();
+			return;
+		}
+	}
+
+	atomic_set(&connection_state, CONNECTION_CONNECTING);
+
+	err = azure_iot_hub_connect(&cfg);
+	if (err == 0)
+	{
+		//The result is reported through AZURE_IOT_HUB_EVT_CONNECTED or AZURE_IOT_HUB_EVT_CONNECTION_FAILED
+		LOG_INF("Connection to Azure requested");
+	}
+	else if (err == -EALREADY)
+	{
+		LOG_INF("Already connected to Azure IoT hub");
+		atomic_set(&connection_state, CONNECTION_CONNECTED);
+	}
+	else
+	{
+		LOG_ERR("azure_iot_hub_connect failed, error: %d", err);
+		connection_retry_schedule();
+	}
+}
+
 static void work_init(void)
 {
 	k_work_init(&method_data.work, direct_method_handler);
 	k_work_init_delayable(&reboot_work, reboot_work_fn);
+	k_work_init_delayable(&store_drain_work, store_drain_work_fn);
+	k_work_init_delayable(&connect_work, connect_work_fn);
 	k_work_queue_start(&application_work_q, application_stack_area, K_THREAD_STACK_SIZEOF(application_stack_area), K_HIGHEST_APPLICATION_THREAD_PRIO, NULL);
 }
 
@@ -434,10 +1190,12 @@ static int dps_run(struct azure_iot_hub_buf *hostname, struct azure_iot_hub_buf
             {
                 return -EFAULT;
             }
+            using_stored_assignment = false;
         break;
 
         case -EALREADY:
             LOG_INF("Already assigned to an IoT hub, skipping DPS");
+            using_stored_assignment = true;
         break;
 
         default:
@@ -498,13 +1256,14 @@ int AzureManagerInit(azureEventHandlerCb azureEventHandler, deviceTwinHandlerCb
 	work_init();
 	cJSON_Init();
 
-	err = dps_run(&cfg.hostname, &cfg.device_id);
-	if (err) 
+	//Messages created while offline are stored here, the device still works without the store
+	err = TelemetryStoreInit();
+	if (err < 0 && err != -EALREADY && err != -ENOTSUP)
 	{
-		LOG_ERR("Failed to run DPS, error: %d, terminating connection attempt", err);
-		return -1;
+		LOG_ERR("Telemetry store could not be initialized, error: %d", err);
 	}
 
+	//The hub assignment is read from the DPS library by the connection supervisor before the first connect
 
 	err = azure_iot_hub_init(azure_event_handler);
 	if (err) 
@@ -519,38 +1278,63 @@ int AzureManagerInit(azureEventHandlerCb azureEventHandler, deviceTwinHandlerCb
 	return 0;
 }
 
-//Connect to azure
+//Connect to azure. The connection is made asynchronously by the connection supervisor,
+//the result is reported through the azureEventHandlerCb callback
+//Returns -EALREADY if the supervisor is already connected or connecting
 int AzureManagerConnect()
 {
-    int err;
-	bool connected = false;
+	uint32_t delay_ms = 0;
 
-	//ToDo Add fallback counter in case connection isn't established
-	while(connected == false)
+	switch (atomic_get(&connection_state))
 	{
-		err = azure_iot_hub_connect(&cfg);
-		if(err == 0)
-		{
-			LOG_INF("Connection to Azure established");
-			connected = true;
-		} 
-		else if(err == -EALREADY)
-		{
-			LOG_INF("Already connected to Azure IoT hub");
-			connected = true;
-		}
-		k_sleep(K_MSEC(250)); //Wait for a short while before again trying to connect
+		case CONNECTION_IDLE:
+			//First connect, no delay
+			break;
+
+		case CONNECTION_BACKOFF:
+			//The network has just come back, retry soon but keep the jitter so the fleet doesn't reconnect at once
+			//A supervisor paused by a network outage has no retry scheduled
+			delay_ms = connection_backoff_ms(1);
+			if (!k_work_delayable_is_pending(&connect_work) || k_work_delayable_remaining_get(&connect_work) > K_MSEC(delay_ms).ticks)
+			{
+				k_work_reschedule_for_queue(&application_work_q, &connect_work, K_MSEC(delay_ms));
+				LOG_INF("Connection retry moved to %d ms", delay_ms);
+			}
+			return -EALREADY;
+
+		default:
+			return -EALREADY;
 	}
 
-    return err;
+	atomic_set(&connection_state, CONNECTION_BACKOFF);
+	k_work_reschedule_for_queue(&application_work_q, &connect_work, K_MSEC(delay_ms));
+	LOG_INF("Connecting to Azure IoT hub");
+
+    return 0;
 }
 
 
+void AzureManagerSetNetworkConnected(bool connected)
+{
+	atomic_set(&network_connected, connected);
+
+	//The pending retry would fail without counting, it is scheduled again when the network is back
+	if (!connected && atomic_get(&connection_state) == CONNECTION_BACKOFF)
+	{
+		k_work_cancel_delayable(&connect_work);
+		LOG_INF("Network is down, connection supervisor paused");
+	}
+}
+
 //Disconnect from azure
 int AzureManagerDisconnect()
 {
     int err;
 
+	//Stop the connection supervisor before disconnecting, so the disconnect isn't retried
+	atomic_set(&connection_state, CONNECTION_IDLE);
+	k_work_cancel_delayable(&connect_work);
+
     err = azure_iot_hub_disconnect();
 	if (err < 0) 
 	{
@@ -562,43 +1346,97 @@ int AzureManagerDisconnect()
 }
 
 //Send a telemtry message to azure. This needs to be a string, and can be formatted into a Json objet using cJson library
-int AzureManagerSendTelemetry(char* telemetryString)
+//The message is copied to the outbound queue of the given priority and published by the sender thread.
+//While the hub isn't connected the message is stored in flash and sent after the next connect
+int AzureManagerSendTelemetry(char* telemetryString, azureManagerPriority priority)
+{
+	return AzureManagerSendTelemetryCb(telemetryString, priority, NULL, NULL);
+}
+
+//Same as AzureManagerSendTelemetry, the completion callback is called from the Azure manager threads when the message is done
+int AzureManagerSendTelemetryCb(char *telemetryString, azureManagerPriority priority, azureManagerSendCompleteCb completeCb, void *pUserData)
 {
     int err;
+	int64_t timestamp_ms = 0;
+	size_t len = strlen(telemetryString);
+	k_spinlock_key_t key;
 
-//	static char buf[1024];
-//	ssize_t len;
-	struct azure_iot_hub_msg msg = 
+	if (priority >= AZURE_MNG_PRIORITY_COUNT)
 	{
-		.topic.type = AZURE_IOT_HUB_TOPIC_EVENT,
-		.payload.ptr = telemetryString,
-		.payload.size = strlen(telemetryString),
-		.qos = MQTT_QOS_0_AT_MOST_ONCE,
-	};
+		return -EINVAL;
+	}
 
-/*
-	len = snprintk(buf, sizeof(buf), telemetryString);
+	//The time is only known when the modem has synchronized it, otherwise the message is sent without a creation time
+	(void)date_time_now(&timestamp_ms);
 
-	if ((len < 0) || (len > sizeof(buf))) 
+	err = enqueue_message(telemetryString, len, timestamp_ms, AZURE_IOT_HUB_TOPIC_EVENT, priority, completeCb, pUserData);
+	if (err == 0)
 	{
-		LOG_ERR("Failed to populate telemetry buffer");
-        return -1;
+		return 0;
 	}
 
-	msg.payload.size = len;
-*/
-	LOG_INF("Sending telemetry string: %s", telemetryString);
-
-	err = azure_iot_hub_send(&msg);
+	//The queue is full, keep the message in flash and let the drain work send it when there is room
+	LOG_WRN("Outbound queue %d full, storing telemetry", priority);
+	err = TelemetryStoreAppend(telemetryString, len, timestamp_ms, priority);
+	key = k_spin_lock(&stats_lock);
 	if (err) 
 	{
-		LOG_ERR("Failed to send telemetry");
+		queue_stats[priority].dropped++;
+	}
+	else
+	{
+		queue_stats[priority].stored++;
+	}
+	k_spin_unlock(&stats_lock, key);
+
+	if (err)
+	{
+		LOG_ERR("Failed to store telemetry");
 		return -1;
 	}
 
-	LOG_INF("Telemetry was successfully sent");
+	if (hubConnected)
+	{
+		k_work_schedule_for_queue(&application_work_q, &store_drain_work, K_MSEC(AZURE_MANAGER_DRAIN_INTERVAL_MS));
+	}
+	return 0;
+}
 
+//Send a device twin reported properties document through the outbound queue
+int AzureManagerSendTwinReport(const char *reportString, size_t length)
+{
+	k_spinlock_key_t key;
+	int err;
+
+	err = enqueue_message(reportString, length, 0, AZURE_IOT_HUB_TOPIC_TWIN_REPORTED, AZURE_MNG_PRIORITY_TWIN_REPORT, NULL, NULL);
+	if (err)
+	{
+		key = k_spin_lock(&stats_lock);
+		queue_stats[AZURE_MNG_PRIORITY_TWIN_REPORT].dropped++;
+		k_spin_unlock(&stats_lock, key);
+		LOG_ERR("Failed to queue twin report, error: %d", err);
+		return -1;
+	}
 	return 0;
 }
-//__________________________________________________________________________________
 
+void AzureManagerGetQueueStats(azureManagerPriority priority, azureManagerQueueStats *pStats)
+{
+	k_spinlock_key_t key;
+
+	if (priority >= AZURE_MNG_PRIORITY_COUNT || pStats == NULL)
+	{
+		return;
+	}
+
+	key = k_spin_lock(&stats_lock);
+	*pStats = queue_stats[priority];
+	k_spin_unlock(&stats_lock, key);
+	pStats->depth = k_msgq_num_used_get(outbound_msgq[priority]);
+}
+
+int64_t AzureManagerGetFirstPublishTime(void)
+{
+	return first_publish_time;
+}
+//__________________________________________________________________________________
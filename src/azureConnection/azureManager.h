@@ -6,8 +6,39 @@
 #define NETWORK_CONNECTION_DISCONNECTED  2
 #define NETWORK_CONNECTION_RECONNECTED   3
 
+//Telemetry stored while offline is sent in batches after a connect, with a pause between the batches
+#define AZURE_MANAGER_TELEMETRY_MAX_SIZE 1024
+#define AZURE_MANAGER_DRAIN_BATCH_SIZE   5
+#define AZURE_MANAGER_DRAIN_INTERVAL_MS  2000
+
+//Outbound queue, messages are published by a dedicated sender thread in priority order
+#define AZURE_MANAGER_QUEUE_DEPTH_ALARM       4
+#define AZURE_MANAGER_QUEUE_DEPTH_TWIN_REPORT 2
+#define AZURE_MANAGER_QUEUE_DEPTH_PERIODIC    2
+#define AZURE_MANAGER_SENDER_STACK_SIZE       KB(4)
+#define AZURE_MANAGER_SENDER_PRIORITY         5
+
+//MQTT QoS used for each priority class. QoS 1 messages are kept in an in-flight window until the PUBACK is received
+#define AZURE_MANAGER_QOS_ALARM               MQTT_QOS_1_AT_LEAST_ONCE
+#define AZURE_MANAGER_QOS_TWIN_REPORT         MQTT_QOS_0_AT_MOST_ONCE
+#define AZURE_MANAGER_QOS_PERIODIC            MQTT_QOS_0_AT_MOST_ONCE
+#define AZURE_MANAGER_INFLIGHT_WINDOW         4  //Number of QoS 1 messages that can wait for a PUBACK at the same time
+#define AZURE_MANAGER_PUBACK_TIMEOUT_S        30 //In-flight messages are retransmitted if the window stays full this long
+
+//Connection supervisor, failed connects are retried with a capped exponential backoff and random jitter
+#define AZURE_MANAGER_BACKOFF_BASE_S          5    //Delay before the first retry
+#define AZURE_MANAGER_BACKOFF_MAX_S           900  //Upper limit for the delay between retries
+//Only attempts made while the network is connected count, the supervisor is paused while it is down
+#define AZURE_MANAGER_MODEM_RESET_ATTEMPTS    8    //Failed attempts in a row before the modem is reset (0 disables)
+#define AZURE_MANAGER_REBOOT_ATTEMPTS         16   //Failed attempts in a row before the device is rebooted (0 disables)
+
+//Direct methods handled by other modules, see AzureManagerRegisterDirectMethod
+#define AZURE_MANAGER_MAX_DIRECT_METHODS      4
+#define AZURE_MANAGER_METHOD_RESPONSE_SIZE    512
+
 //Include libraries needed for the header to compile, often simple libraries like inttypes.h
 #include <inttypes.h>
+#include <zephyr/kernel.h>
 #include <net/azure_iot_hub.h>
 #include <net/azure_iot_hub_dps.h>
 
@@ -26,9 +57,41 @@ typedef struct
 //Callback function types for the Azure manager
 typedef void(*azureEventHandlerCb)(const azureManagerEvent* event);
 
+//Priority classes of the outbound queue, a lower value is sent first
+typedef enum
+{
+    AZURE_MNG_PRIORITY_ALARM,
+    AZURE_MNG_PRIORITY_TWIN_REPORT,
+    AZURE_MNG_PRIORITY_PERIODIC,
+    AZURE_MNG_PRIORITY_COUNT
+} azureManagerPriority;
+
+typedef struct
+{
+    uint32_t depth;         //Messages waiting in the queue right now
+    uint32_t maxDepth;      //Highest number of messages waiting at the same time
+    uint32_t sent;          //Messages published to the hub
+    uint32_t stored;        //Messages stored in flash because the hub wasn't connected or the publish failed
+    uint32_t dropped;       //Messages that could neither be sent nor stored
+    uint32_t latencyAvgMs;  //Average time from enqueue until the publish was handed to the MQTT stack
+    uint32_t latencyMaxMs;  //Highest time from enqueue until the publish was handed to the MQTT stack
+    uint32_t acked;         //QoS 1 messages acknowledged by the hub
+    uint32_t retransmitted; //QoS 1 messages sent again after a reconnect or a PUBACK timeout
+    uint32_t ackLatencyAvgMs; //Average time from enqueue until the PUBACK was received
+    uint32_t ackLatencyMaxMs; //Highest time from enqueue until the PUBACK was received
+} azureManagerQueueStats;
+
+//Called when a message is done: result is 0 when it was acknowledged (QoS 1) or published (QoS 0),
+//-ENOTCONN when it was stored in flash to be sent later (without a callback) or another negative error if it was dropped
+typedef void(*azureManagerSendCompleteCb)(uint16_t messageId, int result, void *pUserData);
+
 // Callback function type for device twin messages
 typedef void(*deviceTwinHandlerCb)(const char *rxDeviceTwinBuf);
 
+//Callback function type for direct methods. Runs on the Azure manager work queue, the returned status code is sent to
+//the hub with the JSON written to response (left empty for no payload), a negative error is sent as status 500
+typedef int(*azureDirectMethodHandlerCb)(const char *payload, char *response, size_t responseSize);
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -39,7 +102,23 @@ int AzureManagerConnect();
 
 int AzureManagerDisconnect();
 
-int AzureManagerSendTelemetry(char *telemetryString);
+//Network (L4) status from the application. While the network is down the connection supervisor is paused,
+//AzureManagerConnect resumes it when the network is back
+void AzureManagerSetNetworkConnected(bool connected);
+
+int AzureManagerSendTelemetry(char *telemetryString, azureManagerPriority priority);
+
+int AzureManagerSendTelemetryCb(char *telemetryString, azureManagerPriority priority, azureManagerSendCompleteCb completeCb, void *pUserData);
+
+int AzureManagerSendTwinReport(const char *reportString, size_t length);
+
+void AzureManagerGetQueueStats(azureManagerPriority priority, azureManagerQueueStats *pStats);
+
+//Uptime in ms when the first message was published after boot, -EAGAIN if nothing has been published yet
+int64_t AzureManagerGetFirstPublishTime(void);
+
+//name must stay valid, returns -ENOMEM when AZURE_MANAGER_MAX_DIRECT_METHODS are registered
+int AzureManagerRegisterDirectMethod(const char *name, azureDirectMethodHandlerCb handler);
 
 #ifdef __cplusplus
 }
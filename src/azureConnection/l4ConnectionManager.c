@@ -9,6 +9,7 @@
 
 #include "deviceReboot.h"
 #include "l4ConnectionManager.h"
+#include "telemetry/bootTimeline.h"
 
 LOG_MODULE_REGISTER(l4ConnectionManager, LOG_LEVEL_INF);
 
@@ -25,6 +26,7 @@ l4ConnectionManagerEventCb connectionManagerHandler;
 static void on_net_event_l4_connected(void)
 {
 	k_sem_give(&network_connected_sem);
+	BootTimelineMark(BOOT_STAGE_NETWORK_CONNECTED);
 	
 	l4ConnectionManagerEvent ev;
 	ev.event=L4_CNCT_MNG_NETWORK_CONNECTED;
@@ -88,8 +90,8 @@ int L4ConnectionManagerNetworkInit(l4ConnectionManagerEventCb l4ConnectionManage
 
 }
 
-//Connect to network
-int L4ConnectionManagerNetworkConnect(uint16_t timeoutSeconds)
+//Start connecting to the network without waiting, the result is reported through the event handler
+int L4ConnectionManagerNetworkConnectStart(void)
 {
    int err;
 
@@ -113,6 +115,20 @@ int L4ConnectionManagerNetworkConnect(uint16_t timeoutSeconds)
 	// If interface was already up, we need to wait for the status to be resent.
 	conn_mgr_mon_resend_status();
 
+	return 0;
+}
+
+//Connect to network, blocks until the network is connected or the timeout expires
+int L4ConnectionManagerNetworkConnect(uint16_t timeoutSeconds)
+{
+   int err;
+
+	err = L4ConnectionManagerNetworkConnectStart();
+	if (err) 
+	{
+		return err;
+	}
+
    err = k_sem_take(&network_connected_sem, K_SECONDS(timeoutSeconds));
 	if (err != 0)
 	{
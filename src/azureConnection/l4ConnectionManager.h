@@ -30,6 +30,8 @@ extern "C" {
 //Functions that should be accessible from the outside 
 int L4ConnectionManagerNetworkInit(l4ConnectionManagerEventCb l4ConnectionManagerEventHandler);
 
+int L4ConnectionManagerNetworkConnectStart(void);
+
 int L4ConnectionManagerNetworkConnect(uint16_t timeoutSeconds);
 
 int L4ConnectionManagerNetworkDisconnect();
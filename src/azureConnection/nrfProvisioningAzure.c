@@ -218,6 +218,46 @@ static int checkForCharInInputBuffer(char charToCheckFor ,k_timeout_t messageTim
 	return result;
 }
 
+//Credentials that are already provisioned are only offered for change in interactive mode,
+//otherwise they are kept without waiting for the user
+static int askToChangeCredential(bool interactive, uint16_t timeToChangeProvData)
+{
+	if (!interactive)
+	{
+		return 0;
+	}
+
+	LOG_DBG("Send a 'C' within %d seconds to change this to something else", timeToChangeProvData);
+	return checkForCharInInputBuffer('C', K_SECONDS(timeToChangeProvData));
+}
+
+//Wait a short time for the escape sequence that requests interactive provisioning
+//Returns true if it was received
+static bool checkForEscapeSequence(uint32_t windowMs)
+{
+	int64_t end = k_uptime_get() + windowMs;
+	int64_t remaining;
+
+	LOG_DBG("Send '%s' within %d ms to enter interactive provisioning", PROVISIONING_ESCAPE_SEQUENCE, windowMs);
+
+	//Anything else received in the window is discarded, it isn't meant for the provisioning menu
+	while ((remaining = end - k_uptime_get()) > 0)
+	{
+		if (k_msgq_get(&uartMsgq, &txBuf, K_MSEC(remaining)) != 0)
+		{
+			break;
+		}
+
+		if (strcmp(txBuf, PROVISIONING_ESCAPE_SEQUENCE) == 0)
+		{
+			clearBuffer(txBuf);
+			return true;
+		}
+	}
+	clearBuffer(txBuf);
+	return false;
+}
+
 static void decodePemFiles(char* inputPemBuf) {
     typedef enum {
         HEADER = 0,
@@ -389,11 +429,14 @@ void DeviceSettingsHandler(DeviceSettingsStatus status)
 
 //Main function of the module which checks for already provisioned data, skips if it exits otherwise prompts the different data that needs to be provisioned
 //in order for an application to connect to Microsoft Azure IoT hub using a SoftSim from ONOMONDO. 
+//A fully provisioned device passes without waiting for the user, unless interactive provisioning is requested through
+//forceInteractive (button held at boot) or the UART escape sequence. Missing credentials are always prompted for.
 //Returns a -1 upon error and 0 upon success
-int NrfProvisioningAzureRunProvisioningCheck(char *deviceIdBuf, char *idScopeBuf, char *serialNoBuf, uint16_t timeToChangeProvData)
+int NrfProvisioningAzureRunProvisioningCheck(char *deviceIdBuf, char *idScopeBuf, char *serialNoBuf, uint16_t timeToChangeProvData, bool forceInteractive)
 {
 	int err;
 	int result;
+	bool interactive;
 
 	bool isProvisioningFinished = 0;
 	enum 
@@ -458,6 +501,12 @@ int NrfProvisioningAzureRunProvisioningCheck(char *deviceIdBuf, char *idScopeBuf
 		return -1;
 	}
 
+	interactive = forceInteractive || checkForEscapeSequence(PROVISIONING_ESCAPE_WINDOW_MS);
+	if (interactive)
+	{
+		LOG_INF("Interactive provisioning requested");
+	}
+
 	provisioningState = idle;
 
 	//Main switch statement that functions as the "menu" for provisioning
@@ -478,9 +527,8 @@ int NrfProvisioningAzureRunProvisioningCheck(char *deviceIdBuf, char *idScopeBuf
 				if(err == 0) 
 				{
 					LOG_DBG("Found device id: %s", bufferDeviceId.ptr);
-					LOG_DBG("Send a 'C' within %d seconds to change this to something else",timeToChangeProvData);
 					//Check if the user wants to change the device id
-					result = checkForCharInInputBuffer('C', K_SECONDS(timeToChangeProvData));
+					result = askToChangeCredential(interactive, timeToChangeProvData);
 					if(result == 1)
 					{
 						LOG_DBG("Changing device id to something else!");
@@ -537,9 +585,8 @@ int NrfProvisioningAzureRunProvisioningCheck(char *deviceIdBuf, char *idScopeBuf
 				if(err == 0) 
 				{
 					LOG_DBG("Found id scope: %s", bufferIdScope.ptr);
-					LOG_DBG("Send a 'C' within %d seconds to change this to something else", timeToChangeProvData);
 					//Check if the user wants to change the device id
-					result = checkForCharInInputBuffer('C', K_SECONDS(timeToChangeProvData));
+					result = askToChangeCredential(interactive, timeToChangeProvData);
 					if(result == 1)
 					{
 						LOG_DBG("Changing id scope to something else!");
@@ -596,9 +643,8 @@ int NrfProvisioningAzureRunProvisioningCheck(char *deviceIdBuf, char *idScopeBuf
 				if(err == 0) 
 				{
 					LOG_DBG("Found serial number: %s", bufferSerialNo.ptr);
-					LOG_DBG("Send a 'C' within %d seconds to change this to something else", timeToChangeProvData);
 					//Check if the user wants to change the device id
-					result = checkForCharInInputBuffer('C', K_SECONDS(timeToChangeProvData));
+					result = askToChangeCredential(interactive, timeToChangeProvData);
 					if(result == 1)
 					{
 						LOG_DBG("Changing serial number to something else!");
@@ -655,8 +701,7 @@ int NrfProvisioningAzureRunProvisioningCheck(char *deviceIdBuf, char *idScopeBuf
 				if(err == 1) 
 				{
 					LOG_DBG("Found main CA certificate!");
-					LOG_DBG("Send a 'C' within %d seconds to change this to something else", timeToChangeProvData);
-					result = checkForCharInInputBuffer('C', K_SECONDS(timeToChangeProvData));
+					result = askToChangeCredential(interactive, timeToChangeProvData);
 					if(result == 1)
 					{
 						LOG_DBG("Changing main CA certificate to something else!");
@@ -712,8 +757,7 @@ int NrfProvisioningAzureRunProvisioningCheck(char *deviceIdBuf, char *idScopeBuf
 				if(err == 1) 
 				{
 					LOG_DBG("Found secondary CA certificate!");
-					LOG_DBG("Send a 'C' within %d seconds to change this to something else", timeToChangeProvData);
-					result = checkForCharInInputBuffer('C', K_SECONDS(timeToChangeProvData));
+					result = askToChangeCredential(interactive, timeToChangeProvData);
 					if(result == 1)
 					{
 						LOG_DBG("Changing secondary CA certificate to something else!");
@@ -767,8 +811,7 @@ int NrfProvisioningAzureRunProvisioningCheck(char *deviceIdBuf, char *idScopeBuf
 				if(err == 1) 
 				{
 					LOG_DBG("Found client certificate!");
-					LOG_DBG("Send a 'C' within %d seconds to change this to something else", timeToChangeProvData);
-					result = checkForCharInInputBuffer('C', K_SECONDS(timeToChangeProvData));
+					result = askToChangeCredential(interactive, timeToChangeProvData);
 					if(result == 1)
 					{
 						LOG_DBG("Changing client certificate to something else!");
@@ -822,8 +865,7 @@ int NrfProvisioningAzureRunProvisioningCheck(char *deviceIdBuf, char *idScopeBuf
 				if(err == 1) 
 				{
 					LOG_DBG("Found private key!");
-					LOG_DBG("Send a 'C' within %d seconds to change this to something else", timeToChangeProvData);
-					result = checkForCharInInputBuffer('C', K_SECONDS(timeToChangeProvData));
+					result = askToChangeCredential(interactive, timeToChangeProvData);
 					if(result == 1)
 					{
 						LOG_DBG("Changing private key to something else!");
@@ -35,6 +35,10 @@
 
 #define TIME_TO_CHANGE_PROVISIONED_DATA  10 //Time to wait for the user to change the provisioned data, if not changed it will be kept
 
+//Interactive provisioning of an already provisioned device is requested by sending this line on the UART right after boot
+#define PROVISIONING_ESCAPE_SEQUENCE     "+++"
+#define PROVISIONING_ESCAPE_WINDOW_MS    1500
+
 //Include libraries needed for the header to compile, often simple libraries like inttypes.h
 #include <stdint.h>
 #include <stdbool.h>
@@ -47,7 +51,7 @@
 extern "C" {
 #endif
 //Functions that should be accessible from the outside 
-int NrfProvisioningAzureRunProvisioningCheck(char *deviceIdBuf, char *idScopeBuf, char *serialNoBuf, uint16_t timeToChangeProvData);
+int NrfProvisioningAzureRunProvisioningCheck(char *deviceIdBuf, char *idScopeBuf, char *serialNoBuf, uint16_t timeToChangeProvData, bool forceInteractive);
 
 #ifdef __cplusplus
 }
@@ -14,6 +14,8 @@
 #include "pam8053AzureDeviceTwin.h"
 #include "modemCommunicator.h"
 #include "deviceSettings.h"
+#include "telemetry/bootTimeline.h"
+#include "universalAlarmInput/universalAlarmInput.h"
 
 LOG_MODULE_REGISTER(Pam8053AzureDeviceTwin, LOG_LEVEL_INF);
 
@@ -27,10 +29,147 @@ static K_SEM_DEFINE(twinRxAndTx, 1, 1);
 //Prototype function for report function
 void Pam8053TwinReportWork();
 
+//Optional number in the device twin, the current value is kept when it's left out. The key is the prefix and the name
+static void Pam8053TwinGetUint16(cJSON *parentObj, const char *prefix, const char *name, uint16_t *pValue)
+{
+	char key[DT_MAX_KEY_LENGTH];
+	cJSON *obj;
+
+	snprintf(key, sizeof(key), "%s%s", prefix, name);
+	obj = cJSON_GetObjectItem(parentObj, key);
+	if (cJSON_IsNumber(obj))
+	{
+		*pValue = CLAMP(obj->valueint, 0, UINT16_MAX);
+	}
+	else if (obj != NULL)
+	{
+		LOG_ERR("Invalid '%s' format received", key);
+	}
+}
+
+static void Pam8053TwinAddUint16(cJSON *parentObj, const char *prefix, const char *name, uint16_t value)
+{
+	char key[DT_MAX_KEY_LENGTH];
+
+	snprintf(key, sizeof(key), "%s%s", prefix, name);
+	cJSON_AddNumberToObject(parentObj, key, value);
+}
+
+//The input configuration is optional, the current configuration is kept for the values that are left out
+static void Pam8053TwinParseInputConfig(cJSON *uConfigObj, const char *prefix, Pam8053InputTwinConfig *pConfig)
+{
+	if (uConfigObj == NULL)
+	{
+		return;
+	}
+
+	Pam8053TwinGetUint16(uConfigObj, prefix, "Mode", &pConfig->mode);
+	Pam8053TwinGetUint16(uConfigObj, prefix, "AssertMs", &pConfig->assertMs);
+	Pam8053TwinGetUint16(uConfigObj, prefix, "ReleaseMs", &pConfig->releaseMs);
+	Pam8053TwinGetUint16(uConfigObj, prefix, "LowMv", &pConfig->lowMv);
+	Pam8053TwinGetUint16(uConfigObj, prefix, "HighMv", &pConfig->highMv);
+	Pam8053TwinGetUint16(uConfigObj, prefix, "HysteresisMv", &pConfig->hysteresisMv);
+	Pam8053TwinGetUint16(uConfigObj, prefix, "TempDelta", &pConfig->tempDelta);
+	Pam8053TwinGetUint16(uConfigObj, prefix, "FilterType", &pConfig->filterType);
+	Pam8053TwinGetUint16(uConfigObj, prefix, "FilterLength", &pConfig->filterLength);
+}
+
+//Only the values that apply to the mode are reported, the report must fit in one outbound message
+static void Pam8053TwinReportInputConfig(cJSON *uConfigObj, const char *prefix, const Pam8053InputTwinConfig *pConfig)
+{
+	Pam8053TwinAddUint16(uConfigObj, prefix, "Mode", pConfig->mode);
+	switch (pConfig->mode)
+	{
+		case UIM_DIGITAL_INPUT_NO:
+		case UIM_DIGITAL_INPUT_NC:
+			Pam8053TwinAddUint16(uConfigObj, prefix, "AssertMs", pConfig->assertMs);
+			Pam8053TwinAddUint16(uConfigObj, prefix, "ReleaseMs", pConfig->releaseMs);
+		break;
+
+		case UIM_VOLTAGE_INPUT:
+			Pam8053TwinAddUint16(uConfigObj, prefix, "LowMv", pConfig->lowMv);
+			Pam8053TwinAddUint16(uConfigObj, prefix, "HighMv", pConfig->highMv);
+			Pam8053TwinAddUint16(uConfigObj, prefix, "HysteresisMv", pConfig->hysteresisMv);
+		break;
+
+		case UIM_TEMPERATURE_NTC:
+		case UIM_TEMPERATURE_PTC:
+			Pam8053TwinAddUint16(uConfigObj, prefix, "TempDelta", pConfig->tempDelta);
+		break;
+
+		default:
+		break;
+	}
+
+	if (pConfig->filterType != INPUT_FILTER_MODE_DEFAULT)
+	{
+		Pam8053TwinAddUint16(uConfigObj, prefix, "FilterType", pConfig->filterType);
+		Pam8053TwinAddUint16(uConfigObj, prefix, "FilterLength", pConfig->filterLength);
+	}
+}
+
+//The twin holds the applied configuration of an input, so the values left out of a twin update are kept
+static void Pam8053TwinLoadInputConfig(uint8_t inputNo, Pam8053InputTwinConfig *pConfig)
+{
+	InputConfig config;
+
+	if (UniversalAlarmInputGetConfig(inputNo, &config) < 0)
+	{
+		return;
+	}
+
+	pConfig->mode = config.mode;
+	pConfig->assertMs = config.assertMs;
+	pConfig->releaseMs = config.releaseMs;
+	pConfig->lowMv = config.lowMv;
+	pConfig->highMv = config.highMv;
+	pConfig->hysteresisMv = config.hysteresisMv;
+	pConfig->tempDelta = config.temperatureDeltaCenti;
+	pConfig->filterType = config.filterType;
+	pConfig->filterLength = config.filterLength;
+}
+
+//Apply the configuration of an input from the twin, afterwards the twin holds the applied configuration to report
+static void Pam8053TwinApplyInputConfig(uint8_t inputNo, Pam8053InputTwinConfig *pConfig)
+{
+	InputConfig config;
+	int err = -EINVAL;
+
+	if (UniversalAlarmInputGetConfig(inputNo, &config) < 0)
+	{
+		return;
+	}
+
+	//The filter fields are 8 bit in the configuration, larger twin values are rejected rather than truncated
+	if (pConfig->filterType <= UINT8_MAX && pConfig->filterLength <= UINT8_MAX)
+	{
+		config.mode = pConfig->mode;
+		config.assertMs = pConfig->assertMs;
+		config.releaseMs = pConfig->releaseMs;
+		config.lowMv = pConfig->lowMv;
+		config.highMv = pConfig->highMv;
+		config.hysteresisMv = pConfig->hysteresisMv;
+		config.temperatureDeltaCenti = pConfig->tempDelta;
+		config.filterType = pConfig->filterType;
+		config.filterLength = pConfig->filterLength;
+		err = UniversalAlarmInputSetConfig(inputNo, &config);
+	}
+
+	if (err < 0)
+	{
+		LOG_WRN("Configuration of input %d from the device twin not applied", inputNo);
+	}
+	Pam8053TwinLoadInputConfig(inputNo, pConfig);
+}
+
 void Pam8053AzureDeviceTwinSetup(Pam8053DeviceTwinStruct *deviceTwinStruct, Pam8053DeviceTwinEventHandlerCb deviceTwinEventHandler)
 {
     pam8053DTStruct = deviceTwinStruct;
 	dtEventHandler = deviceTwinEventHandler;
+
+	//Start from the stored input configuration
+	Pam8053TwinLoadInputConfig(0, &pam8053DTStruct->alarm0Input);
+	Pam8053TwinLoadInputConfig(1, &pam8053DTStruct->alarm1Input);
 }
 
 
@@ -240,7 +379,15 @@ void Pam8053DeviceTwinCb(const char *rxDeviceTwinBuf)
 		LOG_ERR("Invalid alarm 2 name format received");
 	}
 
+	//The input configuration is optional, the current configuration is kept for the values that are left out
+	Pam8053TwinParseInputConfig(u0ConfigObj, "alarm0", &pam8053DTStruct->alarm0Input);
+	Pam8053TwinParseInputConfig(u1ConfigObj, "alarm1", &pam8053DTStruct->alarm1Input);
+
 	cJSON_Delete(rootObj);
+
+	//Applied before the report is built, so a rejected configuration is reported as the one that is running
+	Pam8053TwinApplyInputConfig(0, &pam8053DTStruct->alarm0Input);
+	Pam8053TwinApplyInputConfig(1, &pam8053DTStruct->alarm1Input);
 	
 	//Report the device twin data to Azure IoT Hub
 	Pam8053TwinReportWork();
@@ -254,22 +401,14 @@ void Pam8053TwinReportWork()
 	uint8_t band = 0;
 	
     // Buffer for JSON string
-	char jsonString[512];
-	char buf[1000];
+	char jsonString[AZURE_MANAGER_TELEMETRY_MAX_SIZE];
+	char buf[AZURE_MANAGER_TELEMETRY_MAX_SIZE];
 
 	//Buffer for serial number
 	char serialNo[32];
 
 	ssize_t len;
 
-    // Struct for Azure IoT Hub message
-    struct azure_iot_hub_msg data = 
-	{
-        .topic.type = AZURE_IOT_HUB_TOPIC_TWIN_REPORTED,
-        .payload.ptr = buf,
-        .qos = MQTT_QOS_0_AT_MOST_ONCE,
-    };
-
 	// Get the serial number from the device settings
 	err = DeviceSettingsGetSerialNo(serialNo);
 	if(err < 0)
@@ -368,11 +507,13 @@ void Pam8053TwinReportWork()
 	cJSON_AddItemToObject(root, "u0Config", u0ConfigObj);
 		cJSON_AddNumberToObject(u0ConfigObj, "alarm0Priority", pam8053DTStruct->alarm0Priority);
 		cJSON_AddStringToObject(u0ConfigObj, "alarm0Name", pam8053DTStruct->alarm0Name);
+		Pam8053TwinReportInputConfig(u0ConfigObj, "alarm0", &pam8053DTStruct->alarm0Input);
 
 	//Add u1Config to the JSON object
 	cJSON_AddItemToObject(root, "u1Config", u1ConfigObj);
 		cJSON_AddNumberToObject(u1ConfigObj, "alarm1Priority", pam8053DTStruct->alarm1Priority);
 		cJSON_AddStringToObject(u1ConfigObj, "alarm1Name", pam8053DTStruct->alarm1Name);
+		Pam8053TwinReportInputConfig(u1ConfigObj, "alarm1", &pam8053DTStruct->alarm1Input);
 
 	//Add deviceInfo to the JSON object
 	cJSON_AddItemToObject(root, "deviceInfo", deviceInfo);
@@ -381,24 +522,37 @@ void Pam8053TwinReportWork()
 		cJSON_AddStringToObject(deviceInfo, "version", CONFIG_AZURE_FOTA_APP_VERSION);
 		cJSON_AddStringToObject(deviceInfo, "model", "PAM8053");
 
+	//Add the boot timeline to the first report after boot, stages not reached yet are left out
+	if (BootTimelineTakeReport())
+	{
+		cJSON *bootTimelineObj = cJSON_AddObjectToObject(root, BOOT_TIMELINE_KEY);
+		for (BootStage stage = 0; bootTimelineObj != NULL && stage < BOOT_STAGE_COUNT; stage++)
+		{
+			int64_t stageTime = BootTimelineGet(stage);
+			if (stageTime >= 0)
+			{
+				cJSON_AddNumberToObject(bootTimelineObj, BootTimelineStageName(stage), (double)stageTime);
+			}
+		}
+	}
+
     
 	cJSON_PrintPreallocated(root,jsonString,sizeof(jsonString),false);
 	//Release resources
 	cJSON_Delete(root);
 	
 	len = snprintk(buf, sizeof(buf),jsonString);
-    data.payload.size = len;
 
-    // Send the message to Azure IoT Hub
-    err = azure_iot_hub_send(&data);
+    // Queue the message for Azure IoT Hub, it is published by the Azure manager sender thread
+    err = AzureManagerSendTwinReport(buf, len);
     if (err) 
 	{
         LOG_ERR("Failed to send twin report: %d", err);
-        cJSON_Delete(root);
+        k_sem_give(&twinRxAndTx);
         return;
     }
 
-    LOG_INF("Twin report sent successfully");
+    LOG_INF("Twin report queued successfully");
     LOG_INF("New heartbeat interval has been saved: %d", pam8053DTStruct->heartbeatInterval);
 	LOG_INF("New power meter interval has been saved: %d", pam8053DTStruct->powerMeterInterval);
     LOG_INF("New alarm 1 priority has been saved: %d", pam8053DTStruct->alarm0Priority);
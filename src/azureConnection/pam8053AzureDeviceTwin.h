@@ -3,11 +3,26 @@
 
 //Global macros used by the .c module which needs to easily be modified by the user
 #define DT_MAX_NAME_LENGTH 64
+#define DT_MAX_KEY_LENGTH 32
 
 //Include libraries needed for the header to compile, often simple libraries like inttypes.h
 #include <inttypes.h>
 
 //Global variables that needs to be accessed outside the modules scope
+//Configuration of a universal input, only the values that apply to the mode are reported
+typedef struct
+{
+    uint16_t mode; //InputMode of the universal input
+    uint16_t assertMs; //Debounce time from inactive to active, digital modes
+    uint16_t releaseMs; //Debounce time from active to inactive, digital modes
+    uint16_t lowMv; //Voltage range, voltage mode
+    uint16_t highMv;
+    uint16_t hysteresisMv;
+    uint16_t tempDelta; //Centi degrees, temperature modes
+    uint16_t filterType; //AdcFilterType, 255 for the filter of the mode
+    uint16_t filterLength;
+} Pam8053InputTwinConfig;
+
 typedef struct
 {
     uint16_t heartbeatInterval; //This is the heartbeat interval in seconds
@@ -20,9 +35,11 @@ typedef struct
 
     uint16_t alarm0Priority;
     char alarm0Name[64];
+    Pam8053InputTwinConfig alarm0Input; //alarm0Mode, alarm0AssertMs... in u0Config
 
     uint16_t alarm1Priority;
     char alarm1Name[64];
+    Pam8053InputTwinConfig alarm1Input; //alarm1Mode, alarm1AssertMs... in u1Config
 } Pam8053DeviceTwinStruct;
 
 typedef void(*Pam8053DeviceTwinEventHandlerCb)();
@@ -2,15 +2,18 @@
 //SDK includes
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <zephyr/kernel.h>
 #include <zephyr/sys/reboot.h>
+#include <zephyr/sys/base64.h>
+#include <zephyr/sys/byteorder.h>
 #include <zephyr/device.h>
 #include <zephyr/devicetree.h>
 #include <zephyr/logging/log.h>
 #include <zephyr/drivers/gpio.h>
-#include <cJSON.h>
 #include <date_time.h>
 #include <net/azure_iot_hub.h>
+#include <cJSON.h>
 
 
 //Custom module includes
@@ -31,6 +34,11 @@
 #include "rs485/energyMeter.h"
 #include "rs485/rs485Communication.h"
 
+//Telemetry modules
+#include "telemetry/alarmAggregator.h"
+#include "telemetry/bootTimeline.h"
+#include "telemetry/jsonWriter.h"
+
 //Test modules
 #include "test/pam8053SelfTest.h"
 
@@ -46,7 +54,7 @@
 #include "zigbee/zigbeeManager.h"
 
 //Global variables
-int8_t L4ConnectionManagerStatusGlobal;
+int8_t L4ConnectionManagerStatusGlobal = L4_CNCT_MNG_NETWORK_DISCONNECTED;
 bool azureConnected = false;
 
 Pam8053DeviceTwinStruct pam8053DtStruct;
@@ -59,17 +67,22 @@ char deviceId[16];
 char idScope[12];
 char serialNo[16];
 
-char telemetryBuffer[1024];
+char telemetryBuffer[AZURE_MANAGER_TELEMETRY_MAX_SIZE];
 
-typedef struct 
-{
-    char alarmId[64]; 			
-    char name[64]; 				
-    char text[64]; 				
-    char eventTimestamp[32];
-    uint8_t type; 				
-    uint8_t priority;
-} Alarm;
+//Alarm channels used in the telemetry, in case of inputs the alarm channel is the same as the input no.
+//The other channels follow the inputs, so they don't collide on hardware with more inputs
+#define ALARM_CHANNEL_POWER_FAILURE (MAX_UIE_INPUTS + 1)
+#define ALARM_CHANNEL_HEARTBEAT (MAX_UIE_INPUTS + 2)
+#define ALARM_CHANNEL_CODE_PANEL (MAX_UIE_INPUTS + 3)
+
+#define ALARM_TYPE_ALARM 1
+#define ALARM_TYPE_HEARTBEAT 2
+
+#define HEARTBEAT_PRIORITY 9
+#define CODE_PANEL_PRIORITY 5
+#define INPUT_DEFAULT_PRIORITY 1 //Inputs without a name and priority in the device twin (input 2 and up)
+
+bool heartbeatPending = false; //True when the pending alarm message contains the heartbeat, the connection data is then added
 
 float dbMin = 0;
 float dbMax = -100;
@@ -77,10 +90,52 @@ float dbMax = -100;
 float dbmMin = 0;
 float dbmMax = -100;
 
-uint16_t timeToChangeProv = 0;
+uint16_t timeToChangeProv = TIME_TO_CHANGE_PROVISIONED_DATA; //Only used in interactive provisioning
+
+//Main dispatcher, the main thread sleeps on this queue until a module posts an event to it
+#define MAIN_EVENT_QUEUE_SIZE 16
+#define THERMOSTAT_CHECK_INTERVAL_S 60 //Interval between checks of the Zigbee temperature for the heating relay
+#define THERMOSTAT_ON_CENTI 1800 //The heating is turned on below this temperature
+#define THERMOSTAT_OFF_CENTI 2200 //The heating is turned off above this temperature
+#define WAKEUP_STATS_INTERVAL_S 3600 //Interval between logs of the dispatcher wakeup counter (wakeups per hour)
+#define NETWORK_CONNECT_TIMEOUT_S 300 //The device is rebooted if the network isn't connected this long after boot
+#define PROVISIONING_BUTTON_ID 0 //Holding this button at boot enters interactive provisioning
+
+typedef enum
+{
+	MAIN_EVT_CONNECTIVITY_CHECK,
+	MAIN_EVT_L4_STATUS,
+	MAIN_EVT_AZURE_STATUS,
+	MAIN_EVT_HEARTBEAT_TIMER,
+	MAIN_EVT_ENERGY_METER_TIMER,
+	MAIN_EVT_THERMOSTAT_TIMER,
+	MAIN_EVT_INPUT,
+	MAIN_EVT_CODE_PANEL,
+	MAIN_EVT_ALARM_FLUSH,
+	MAIN_EVT_WAKEUP_STATS,
+	MAIN_EVT_NETWORK_TIMEOUT,
+	MAIN_EVT_SAVE_INPUT_CONFIG
+} MainEventType;
+
+typedef struct
+{
+	MainEventType type;
+	union
+	{
+		l4ConnectionManagerEventType l4Status;
+		azureManagerEventType azureStatus;
+		InputEvent input;
+		codepanelEvent codePanel;
+	} data;
+} MainEvent;
+
+K_MSGQ_DEFINE(mainEventMsgq, sizeof(MainEvent), MAIN_EVENT_QUEUE_SIZE, 4);
+
+static uint32_t dispatcherWakeups;
 
-bool transmitHeartbeatTelemetry = false;
-bool transmitEnergyMeterReading = false;
+//Latest temperature of the inputs in temperature mode, the thermostat uses the first valid one before the Zigbee sensor
+static int16_t inputTemperature[MAX_UIE_INPUTS];
+static bool inputTemperatureValid[MAX_UIE_INPUTS];
 
 void heartbeatTimerHandlerCb(struct k_timer *timer) ;
 K_TIMER_DEFINE(heartbeatTimer, heartbeatTimerHandlerCb, NULL); //This timer is used to send the heartbeat telemetry at the specified interval
@@ -88,6 +143,15 @@ K_TIMER_DEFINE(heartbeatTimer, heartbeatTimerHandlerCb, NULL); //This timer is u
 void energyMeterTimerHandlerCb(struct k_timer *timer) ;
 K_TIMER_DEFINE(energyMeterTimer, energyMeterTimerHandlerCb, NULL); //This timer is used to send the energy meter readings at the specified interval
 
+void thermostatTimerHandlerCb(struct k_timer *timer) ;
+K_TIMER_DEFINE(thermostatTimer, thermostatTimerHandlerCb, NULL); //This timer is used to check the temperature for the heating relay
+
+void wakeupStatsTimerHandlerCb(struct k_timer *timer) ;
+K_TIMER_DEFINE(wakeupStatsTimer, wakeupStatsTimerHandlerCb, NULL); //This timer is used to log the number of dispatcher wakeups
+
+void networkTimeoutTimerHandlerCb(struct k_timer *timer) ;
+K_TIMER_DEFINE(networkTimeoutTimer, networkTimeoutTimerHandlerCb, NULL); //This timer limits the time the first network attach may take
+
 
 
 LOG_MODULE_REGISTER(main, LOG_LEVEL_INF);
@@ -99,13 +163,20 @@ void L4ConnectionManagerCb(const l4ConnectionManagerEvent* event);
 void AzureManagerStatusCb(const azureManagerEvent* event);
 void UniversalAlarmInputCb(const InputEvent* event);
 void heartbeatTimerHandlerCb(struct k_timer *timer);
+void MainEventPost(MainEventType type);
 
 //Function prototypes for telemetry functions
 void FormatTimestamp(char* pBuffer, size_t bufferSize, uint64_t timestamp);
-cJSON *CreateConnectionDataObject();
-cJSON* CreateAlarmObject(const Alarm* pAlarm, uint8_t alarmChannel);
-cJSON* CreateHeartbeatTelemetry(void);
-void TransmitHeartbeatTelemetry(void);
+void WriteConnectionDataObject(JsonWriter *pWriter, const char *key);
+void WriteAdcTimingObject(JsonWriter *pWriter, const char *key);
+void WriteAlarmObject(JsonWriter *pWriter, const Alarm* pAlarm, uint8_t alarmChannel);
+int CreateAlarmTelemetry(char *pBuffer, size_t bufferSize, uint8_t *pAlarmCount);
+void TransmitAlarmTelemetry(void);
+void FillAlarm(Alarm* pAlarm, const char* idSuffix, const char* text, uint8_t type, uint8_t priority);
+int QueueAlarm(const Alarm* pAlarm, uint8_t alarmChannel);
+void QueueHeartbeatAlarm(void);
+int CalibrateAdcMethodCb(const char *payload, char *response, size_t responseSize);
+int GetAdcCaptureMethodCb(const char *payload, char *response, size_t responseSize);
 
 void updateTimer(struct k_timer *timer, uint32_t newInterval);
 
@@ -122,6 +193,20 @@ void updateTimer(struct k_timer *timer, uint32_t newInterval)
 	LOG_INF("Timer updated to %ds", newInterval);
 }
 
+//Post an event without payload to the main dispatcher, safe to call from ISR context (timers)
+void MainEventPost(MainEventType type)
+{
+	MainEvent ev = 
+	{
+		.type = type
+	};
+
+	if (k_msgq_put(&mainEventMsgq, &ev, K_NO_WAIT) != 0)
+	{
+		LOG_WRN("Main event queue full, event %d dropped", type);
+	}
+}
+
 
 //_____________________________________________________________________________________________________________________
 //Callback functions
@@ -142,6 +227,9 @@ void Pam80053AzureDeviceTwinCb()
 		RelayControlRelayOff(1);
 	}
 
+	//The input configuration is applied by the device twin module, storing it writes flash so it's done by the dispatcher
+	MainEventPost(MAIN_EVT_SAVE_INPUT_CONFIG);
+
 	if(pam8053DtStruct.relay2Status == 1)
 	{
 		RelayControlRelayOn(2);
@@ -163,20 +251,176 @@ void Pam80053AzureDeviceTwinCb()
 
 void L4ConnectionManagerCb(const l4ConnectionManagerEvent* event)
 {
-	L4ConnectionManagerStatusGlobal = event->event;
-	LOG_INF("networkStatusGlobal has value: %d",L4ConnectionManagerStatusGlobal);
+	MainEvent ev = 
+	{
+		.type = MAIN_EVT_L4_STATUS,
+		.data.l4Status = event->event
+	};
+
+	if (k_msgq_put(&mainEventMsgq, &ev, K_NO_WAIT) != 0)
+	{
+		LOG_WRN("Main event queue full, L4 status %d dropped", event->event);
+	}
 }
 
 void AzureManagerStatusCb(const azureManagerEvent* event)
 {
-	azureConnected = event->event == AZURE_MNG_NETWORK_CONNECTED ? true : false;;
-	LOG_INF("azureConnected has value: %s", azureConnected ? "true" : "false");
+	MainEvent ev = 
+	{
+		.type = MAIN_EVT_AZURE_STATUS,
+		.data.azureStatus = event->event
+	};
+
+	if (k_msgq_put(&mainEventMsgq, &ev, K_NO_WAIT) != 0)
+	{
+		LOG_WRN("Main event queue full, Azure status %d dropped", event->event);
+	}
 }
 
 void UniversalAlarmInputCb(const InputEvent* event)
+{
+	MainEvent ev = 
+	{
+		.type = MAIN_EVT_INPUT,
+		.data.input = *event
+	};
+
+	//The input callback runs on the ADC work queue, the event is handled by the main dispatcher
+	if (k_msgq_put(&mainEventMsgq, &ev, K_NO_WAIT) != 0)
+	{
+		LOG_WRN("Main event queue full, event on input %d dropped", event->inputNo);
+	}
+}
+
+//Direct method "CalibrateAdc", payload {"channel": n, "referenceMv": mv} or {"channel": n, "reset": true}
+//A reference of 0 mV (or none) calibrates the offset, the input must be at the reference while the method runs
+int CalibrateAdcMethodCb(const char *payload, char *response, size_t responseSize)
+{
+	cJSON *root;
+	cJSON *obj;
+	AdcDtsCalibration calibration;
+	int channel = -1;
+	int referenceMv = 0;
+	bool reset = false;
+	int err;
+
+	root = cJSON_Parse(payload);
+	if (root == NULL)
+	{
+		return 400;
+	}
+	obj = cJSON_GetObjectItem(root, "channel");
+	if (cJSON_IsNumber(obj))
+	{
+		channel = obj->valueint;
+	}
+	obj = cJSON_GetObjectItem(root, "referenceMv");
+	if (cJSON_IsNumber(obj))
+	{
+		referenceMv = obj->valueint;
+	}
+	reset = cJSON_IsTrue(cJSON_GetObjectItem(root, "reset"));
+	cJSON_Delete(root);
+
+	if (channel < 0 || channel >= ADC_DTS_CHANNEL_COUNT)
+	{
+		return 400;
+	}
+
+	if (reset)
+	{
+		err = AdcDtsResetCalibration(channel);
+	}
+	else if (referenceMv == 0)
+	{
+		err = AdcDtsCalibrateOffset(channel);
+	}
+	else
+	{
+		err = AdcDtsCalibrateGain(channel, referenceMv);
+	}
+
+	if (err == 0)
+	{
+		err = AdcDtsSaveCalibration();
+	}
+	if (err < 0)
+	{
+		snprintk(response, responseSize, "{\"error\":%d}", err);
+		return err == -ERANGE ? 422 : 500;
+	}
+
+	AdcDtsGetCalibration(channel, &calibration);
+	snprintk(response, responseSize, "{\"channel\":%d,\"offset\":%d,\"gainPpm\":%u}", channel, calibration.offset, calibration.gainPpm);
+	return 200;
+}
+
+//Direct method "GetAdcCapture", payload {"channel": n}. The samples of the latest capture are sent base64 encoded,
+//4 bytes per sample: time in ms (uint16) and raw value (int16), little endian
+int GetAdcCaptureMethodCb(const char *payload, char *response, size_t responseSize)
+{
+	static AdcDtsCapture capture;
+	static uint8_t packed[sizeof(capture.samples)];
+	cJSON *root;
+	cJSON *obj;
+	int channel = -1;
+	size_t length;
+	int written;
+	int err;
+
+	root = cJSON_Parse(payload);
+	if (root == NULL)
+	{
+		return 400;
+	}
+	obj = cJSON_GetObjectItem(root, "channel");
+	if (cJSON_IsNumber(obj))
+	{
+		channel = obj->valueint;
+	}
+	cJSON_Delete(root);
+
+	if (channel < 0 || channel >= ADC_DTS_CHANNEL_COUNT)
+	{
+		return 400;
+	}
+
+	err = AdcDtsGetCapture(channel, &capture);
+	if (err < 0)
+	{
+		return err == -ENODATA ? 404 : 500;
+	}
+
+	for (int i = 0; i < capture.count; i++)
+	{
+		sys_put_le16(capture.samples[i].timeMs, &packed[i * 4]);
+		sys_put_le16((uint16_t)capture.samples[i].value, &packed[i * 4 + 2]);
+	}
+
+	written = snprintk(response, responseSize, "{\"channel\":%d,\"sequence\":%u,\"triggerTime\":%lld,\"count\":%d,\"triggerIndex\":%d,\"data\":\"",
+		channel, capture.sequence, capture.triggerTime, capture.count, capture.triggerIndex);
+	if (written < 0 || written >= responseSize)
+	{
+		return 500;
+	}
+
+	err = base64_encode(&response[written], responseSize - written, &length, packed, capture.count * 4);
+	if (err < 0 || written + length + 3 > responseSize)
+	{
+		LOG_ERR("ADC capture doesn't fit the response");
+		return 500;
+	}
+	strcpy(&response[written + length], "\"}");
+	return 200;
+}
+
+void HandleUniversalAlarmInputEvent(const InputEvent* event)
 {
 	// In case of inputs, the alarm channel is the same as the input no.
 	bool transmitTelemetry = false;
+	char idSuffix[8];
+	const char *text = NULL;
+	Alarm alarm;
 
 	switch (event->event)
 	{
@@ -186,8 +430,44 @@ void UniversalAlarmInputCb(const InputEvent* event)
 		break;
 
 		case UIE_INPUT_CHANGED:
+			//Temperatures are measurements, not alarms
+			if (event->mode == UIM_TEMPERATURE_NTC || event->mode == UIM_TEMPERATURE_PTC)
+			{
+				inputTemperature[event->inputNo] = event->value.iValue;
+				inputTemperatureValid[event->inputNo] = true;
+				LOG_INF("Input %d temperature %d centi degrees", event->inputNo, event->value.iValue);
+				break;
+			}
+			inputTemperatureValid[event->inputNo] = false;
+
+			//Voltage inputs only send range changes
+			if (event->mode == UIM_VOLTAGE_INPUT)
+			{
+				text = event->range == VOLTAGE_RANGE_LOW ? "Voltage low" : event->range == VOLTAGE_RANGE_HIGH ? "Voltage high" : "Voltage normal";
+				LOG_INF("Input %d %s at %d mV", event->inputNo, text, event->value.uValue);
+				transmitTelemetry = true;
+				break;
+			}
+
 			LOG_INF("Input %d changed to %s", event->inputNo, event->value.bValue == true ? "Active" : "Inactive");
 
+			text = event->value.bValue == true ? "Active" : "Inactive";
+			transmitTelemetry = true;
+		break;
+
+		case UIE_INPUT_FAULT:
+			//Tamper on a supervised loop or a broken temperature sensor, the value is the supervised state
+			if (event->mode == UIM_TEMPERATURE_NTC || event->mode == UIM_TEMPERATURE_PTC)
+			{
+				inputTemperatureValid[event->inputNo] = false;
+				text = event->value.uValue == SUPERVISED_STATE_TAMPER_SHORT ? "Sensor short" : "Sensor open";
+			}
+			else
+			{
+				text = event->value.uValue == SUPERVISED_STATE_TAMPER_SHORT ? "Tamper short" : "Tamper open";
+			}
+			LOG_WRN("Input %d fault: %s", event->inputNo, text);
+
 			transmitTelemetry = true;
 		break;
 
@@ -197,12 +477,37 @@ void UniversalAlarmInputCb(const InputEvent* event)
 
 	if (transmitTelemetry)
 	{
-
+		snprintf(idSuffix, sizeof(idSuffix), "U%d", event->inputNo);
+		FillAlarm(&alarm, idSuffix, text, ALARM_TYPE_ALARM,
+			event->inputNo == 0 ? pam8053DtStruct.alarm0Priority :
+			event->inputNo == 1 ? pam8053DtStruct.alarm1Priority : INPUT_DEFAULT_PRIORITY);
+		QueueAlarm(&alarm, event->inputNo);
 	}
 }
 
 void CodePanelStatusCb(const codepanelEvent* event)
 {
+	MainEvent ev = 
+	{
+		.type = MAIN_EVT_CODE_PANEL,
+		.data.codePanel = *event
+	};
+
+	if (k_msgq_put(&mainEventMsgq, &ev, K_NO_WAIT) != 0)
+	{
+		LOG_WRN("Main event queue full, code panel event %d dropped", event->status);
+	}
+}
+
+void AlarmAggregatorFlushCb(void)
+{
+	MainEventPost(MAIN_EVT_ALARM_FLUSH);
+}
+
+void HandleCodePanelEvent(const codepanelEvent* event)
+{
+	Alarm alarm;
+
 	//Handle the code panel status events here
 	switch (event->status)
 	{
@@ -217,19 +522,25 @@ void CodePanelStatusCb(const codepanelEvent* event)
 		case CODE_PANEL_CODE_ERROR:
 			LOG_ERR("Code error: %d", event->errorCode);
 			//ToDo add a report to the Azure device twin
-			
+			FillAlarm(&alarm, "CP", "Code error", ALARM_TYPE_ALARM, CODE_PANEL_PRIORITY);
+			QueueAlarm(&alarm, ALARM_CHANNEL_CODE_PANEL);
+
 		break;
 
 		case DOOR_OPEN:
 			LOG_INF("Door opened");
 			//ToDo add a report to the Azure device twin
 			IndicatorModuleLedBlinkFast(GREEN_LED); //Blink the green LED to indicate that the door was opened
+			FillAlarm(&alarm, "CP", "Door opened", ALARM_TYPE_ALARM, CODE_PANEL_PRIORITY);
+			QueueAlarm(&alarm, ALARM_CHANNEL_CODE_PANEL);
 		break;
 
 		case DOOR_CLOSED:
 			LOG_INF("Door closed");
 			//ToDo add a report to the Azure device twin
 			IndicatorModuleLedOff(GREEN_LED); //Turn of the green LED to indicate that the door was closed
+			FillAlarm(&alarm, "CP", "Door closed", ALARM_TYPE_ALARM, CODE_PANEL_PRIORITY);
+			QueueAlarm(&alarm, ALARM_CHANNEL_CODE_PANEL);
 		break;
 
 		default:
@@ -241,14 +552,28 @@ void CodePanelStatusCb(const codepanelEvent* event)
 void heartbeatTimerHandlerCb(struct k_timer *timer) 
 {
     LOG_DBG("Timer expired!");
-	transmitHeartbeatTelemetry = true;
-	LOG_INF("Heartbeat telemetry sent, waiting for next interval of %ds", pam8053DtStruct.heartbeatInterval);
+	MainEventPost(MAIN_EVT_HEARTBEAT_TIMER);
 }
 
 void energyMeterTimerHandlerCb(struct k_timer *timer) 
 {
     LOG_DBG("Timer expired!");
-	transmitEnergyMeterReading = true;
+	MainEventPost(MAIN_EVT_ENERGY_METER_TIMER);
+}
+
+void thermostatTimerHandlerCb(struct k_timer *timer) 
+{
+	MainEventPost(MAIN_EVT_THERMOSTAT_TIMER);
+}
+
+void wakeupStatsTimerHandlerCb(struct k_timer *timer) 
+{
+	MainEventPost(MAIN_EVT_WAKEUP_STATS);
+}
+
+void networkTimeoutTimerHandlerCb(struct k_timer *timer) 
+{
+	MainEventPost(MAIN_EVT_NETWORK_TIMEOUT);
 }
 
 void buttonsHandlerCb(const buttonsHandlerEvent* status)
@@ -292,15 +617,17 @@ void FormatTimestamp(char* pBuffer, size_t bufferSize, uint64_t timestamp)
 	}
 }
 
-cJSON *CreateConnectionDataObject()
+//Write the connection data object, with the given key, into the telemetry document
+void WriteConnectionDataObject(JsonWriter *pWriter, const char *key)
 {
 	int err;
 	int8_t rxlev, ber, rscp, ecno, rsrq, rsrp;
+	int32_t rsrqLowerDeciDb;
 	float rsrqLowerDb;
 	int rsrpLowerDb;
 	uint8_t band;
 
-	cJSON *root = cJSON_CreateObject();
+	JsonWriterObjectStart(pWriter, key);
 
 	err = ModemCommunicatorAtCommandCesq(&rxlev, &ber, &rscp, &ecno, &rsrq, &rsrp);
 	if(err < 0)
@@ -312,8 +639,13 @@ cJSON *CreateConnectionDataObject()
 	{
 		//Add the rsrq and rsrp values to the heartbeat telemetry data, only the low values are calculated
 		//since the high values simply are: rsrq_high = rsrq + 0.5 and rsrp = rsrp + 1
-		cJSON_AddNumberToObject(root, "rsrq_low_dB", rsrqLowerDb = (rsrq - 40) / 2.0);
-		cJSON_AddNumberToObject(root, "rsrp_low_dBm", rsrpLowerDb = rsrp - 141);
+		//rsrq is written as a fixed point value with one decimal: (rsrq - 40) / 2 = (rsrq - 40) * 5 / 10
+		rsrqLowerDeciDb = (rsrq - 40) * 5;
+		rsrqLowerDb = rsrqLowerDeciDb / 10.0f;
+		rsrpLowerDb = rsrp - 141;
+
+		JsonWriterAddDecimal(pWriter, "rsrq_low_dB", rsrqLowerDeciDb, 1);
+		JsonWriterAddInt(pWriter, "rsrp_low_dBm", rsrpLowerDb);
 		
 		if(rsrqLowerDb > dbMax)
 		{
@@ -343,108 +675,220 @@ cJSON *CreateConnectionDataObject()
 	}
 	else
 	{
-		cJSON_AddNumberToObject(root, "band", band);
+		JsonWriterAddInt(pWriter, "band", band);
 	}
 
-	return root;
+	JsonWriterObjectEnd(pWriter);
 }
 
-// Create a json object to send from an alarm, the user should make sure to delete the object after use
-cJSON* CreateAlarmObject(const Alarm* pAlarm, uint8_t alarmChannel)
+//Timing of the ADC sampling path as [min, mean, max] in us, with the histogram of the start latency
+//Kept compact, the message also has to fit the alarms
+void WriteAdcTimingObject(JsonWriter *pWriter, const char *key)
 {
-	cJSON *alarm = cJSON_CreateObject();
+	AdcDtsStats stats;
+	const AdcDtsLatencyStats *pLatencies[] = {&stats.timerJitter, &stats.startLatency, &stats.dispatchLatency};
+	const char *const names[] = {"jitterUs", "startUs", "dispatchUs"};
+
+	AdcDtsGetStats(&stats);
+	JsonWriterObjectStart(pWriter, key);
+
+	for (int i = 0; i < ARRAY_SIZE(pLatencies); i++)
+	{
+		JsonWriterArrayStart(pWriter, names[i]);
+		JsonWriterAddInt(pWriter, NULL, pLatencies[i]->minUs);
+		JsonWriterAddInt(pWriter, NULL, pLatencies[i]->meanUs);
+		JsonWriterAddInt(pWriter, NULL, pLatencies[i]->maxUs);
+		JsonWriterArrayEnd(pWriter);
+	}
+
+	JsonWriterArrayStart(pWriter, "startHist");
+	for (int i = 0; i < ADC_DTS_HISTOGRAM_BUCKETS; i++)
+	{
+		JsonWriterAddInt(pWriter, NULL, stats.startLatency.histogram[i]);
+	}
+	JsonWriterArrayEnd(pWriter);
+
+	JsonWriterObjectEnd(pWriter);
+}
+
+// Write a json object for an alarm, this is used as an element in the alarms array
+void WriteAlarmObject(JsonWriter *pWriter, const Alarm* pAlarm, uint8_t alarmChannel)
+{
+	JsonWriterObjectStart(pWriter, NULL);
 
 	// Create a single alarm object
-	cJSON_AddStringToObject(alarm, "alarmId", pAlarm->alarmId);
+	JsonWriterAddString(pWriter, "alarmId", pAlarm->alarmId);
 
 	switch (alarmChannel)
 	{
 		//Alarm channel 1
 		case 0:
-			cJSON_AddStringToObject(alarm, "name", pam8053DtStruct.alarm0Name);
-			cJSON_AddNumberToObject(alarm, "priority", pam8053DtStruct.alarm0Priority);
+			JsonWriterAddString(pWriter, "name", pam8053DtStruct.alarm0Name);
+			JsonWriterAddInt(pWriter, "priority", pam8053DtStruct.alarm0Priority);
 		break;
 
 		//Alarm channel 2
 		case 1:
-			cJSON_AddStringToObject(alarm, "name", pam8053DtStruct.alarm1Name);
-			cJSON_AddNumberToObject(alarm, "priority", pam8053DtStruct.alarm1Priority);
+			JsonWriterAddString(pWriter, "name", pam8053DtStruct.alarm1Name);
+			JsonWriterAddInt(pWriter, "priority", pam8053DtStruct.alarm1Priority);
 		break;
 
 		//Alarm channel 3, this is the power failure alarm
 		//For now is this text added in the CreatePowerFailureTelemetry function, but it could be added here as well
-		case 3:
+		case ALARM_CHANNEL_POWER_FAILURE:
 
 		break;
 
 		//Alarm channel 4, this is the heartbeat alarm
-		//For now is this text added in the CreateHeartbeatTelemetry function, but it could be added here as well
-		case 4:
+		//For now is this text added in the QueueHeartbeatAlarm function, but it could be added here as well
+		case ALARM_CHANNEL_HEARTBEAT:
 
 		break;
 
+		//Alarm channel 5, this is the code panel
+		case ALARM_CHANNEL_CODE_PANEL:
+			JsonWriterAddString(pWriter, "name", "Code panel");
+			JsonWriterAddInt(pWriter, "priority", pAlarm->priority);
+		break;
+
 		//Can be used to implement a error alarm text, otherwise leave it empty
 		default:	
-			LOG_ERR("Alarm channel %d is not supported!", alarmChannel);
+			if (alarmChannel < MAX_UIE_INPUTS)
+			{
+				char name[16];
+
+				snprintf(name, sizeof(name), "Input %d", alarmChannel + 1);
+				JsonWriterAddString(pWriter, "name", name);
+				JsonWriterAddInt(pWriter, "priority", pAlarm->priority);
+			}
+			else
+			{
+				LOG_ERR("Alarm channel %d is not supported!", alarmChannel);
+			}
 		break;
 	}
 	
-	cJSON_AddStringToObject(alarm, "eventTimestamp", pAlarm->eventTimestamp);
+	JsonWriterAddString(pWriter, "eventTimestamp", pAlarm->eventTimestamp);
 	//Consider if this should be put into the switch statement instead, in case this should be device twin configurable
-	cJSON_AddStringToObject(alarm, "text", pAlarm->text);
-	cJSON_AddNumberToObject(alarm, "type", pAlarm->type);
+	JsonWriterAddString(pWriter, "text", pAlarm->text);
+	JsonWriterAddInt(pWriter, "type", pAlarm->type);
 
-	return alarm;
+	JsonWriterObjectEnd(pWriter);
 }
 
-cJSON* CreateHeartbeatTelemetry(void)
+//Fill in an alarm with the current time, the alarm id is the device id followed by the suffix
+void FillAlarm(Alarm* pAlarm, const char* idSuffix, const char* text, uint8_t type, uint8_t priority)
 {
-	Alarm alarm;
 	int64_t now = 0;
+
+	memset(pAlarm, 0, sizeof(*pAlarm));
+	date_time_now_local(&now);
+
+	snprintf(pAlarm->alarmId, sizeof(pAlarm->alarmId), "%s/%s", deviceId, idSuffix);
+	pAlarm->type = type;
+	pAlarm->priority = priority;
+	strncpy(pAlarm->name, deviceId, sizeof(pAlarm->name) - 1);
+	strncpy(pAlarm->text, text, sizeof(pAlarm->text) - 1);
+	FormatTimestamp(pAlarm->eventTimestamp, sizeof(pAlarm->eventTimestamp), now);
+}
+
+//Add an alarm to the pending telemetry message, the message is sent by the aggregator when the window closes
+int QueueAlarm(const Alarm* pAlarm, uint8_t alarmChannel)
+{
 	int err;
 
-	err = date_time_now_local(&now);
+	err = AlarmAggregatorAdd(pAlarm, alarmChannel);
+	if (err == -ENOMEM)
+	{
+		//The pending message is full, send it and start a new one with this alarm
+		TransmitAlarmTelemetry();
+		err = AlarmAggregatorAdd(pAlarm, alarmChannel);
+	}
 
-	snprintf(alarm.alarmId, sizeof(alarm.alarmId), "%s/HB", deviceId);
-	alarm.type = 2;
-	alarm.priority = 9;
-	strncpy(alarm.name, deviceId, sizeof(alarm.name) - 1);
-	strncpy(alarm.text, "Heartbeat", sizeof(alarm.text) - 1);
-	FormatTimestamp(alarm.eventTimestamp, sizeof(alarm.eventTimestamp), now);
+	if (err < 0)
+	{
+		LOG_ERR("Could not queue alarm %s, error: %d", pAlarm->alarmId, err);
+	}
+	return err;
+}
 
-	//Create a json object to send
-	cJSON *root = cJSON_CreateObject();
+void QueueHeartbeatAlarm(void)
+{
+	Alarm alarm;
 
-	//Create a connection data object and add it to the telemetry data
-	cJSON *connectionDataObject = CreateConnectionDataObject();
-	cJSON_AddItemToObject(root, "atCommandData", connectionDataObject);
+	FillAlarm(&alarm, "HB", "Heartbeat", ALARM_TYPE_HEARTBEAT, HEARTBEAT_PRIORITY);
 
-	// The alarm object should be an array of alarm objects.
-	cJSON *alarmsArray = cJSON_AddArrayToObject(root, "alarms");
-	cJSON *object = CreateAlarmObject(&alarm, 4);
-	cJSON_AddItemToArray(alarmsArray, object);
-	return root;
+	//Set when the heartbeat is in the pending message, a full message is sent without it first
+	if (QueueAlarm(&alarm, ALARM_CHANNEL_HEARTBEAT) == 0)
+	{
+		heartbeatPending = true;
+	}
 }
 
-void TransmitHeartbeatTelemetry(void)
+//Create the telemetry for all pending alarms directly in the given buffer
+//Returns the length of the telemetry string, or a negative error code if the buffer was too small
+int CreateAlarmTelemetry(char *pBuffer, size_t bufferSize, uint8_t *pAlarmCount)
 {
-	if (azureConnected)
+	JsonWriter writer;
+	int err;
+
+	JsonWriterInit(&writer, pBuffer, bufferSize);
+	JsonWriterObjectStart(&writer, NULL);
+
+	//The connection data is only part of the message when it contains the heartbeat
+	if (heartbeatPending)
 	{
-		//cJSON* pTelemetryObject = CreateFullAlarmTelemetry();
-		cJSON* pTelemetryObject = CreateHeartbeatTelemetry();
+		WriteConnectionDataObject(&writer, "atCommandData");
+		WriteAdcTimingObject(&writer, "adcTiming");
+	}
 
-		//"Export" the json object to the adcTelemetryBuffer
-		cJSON_PrintPreallocated(pTelemetryObject, telemetryBuffer, sizeof(telemetryBuffer), false);
-		
-		cJSON_Delete(pTelemetryObject);
-	
-		//Send the telemetry data 
-		AzureManagerSendTelemetry(telemetryBuffer);
+	// The alarm object should be an array of alarm objects.
+	JsonWriterArrayStart(&writer, "alarms");
+	*pAlarmCount = AlarmAggregatorWrite(&writer);
+	JsonWriterArrayEnd(&writer);
+
+	JsonWriterObjectEnd(&writer);
+
+	err = JsonWriterFinish(&writer);
+	if (err == -ENOMEM)
+	{
+		LOG_ERR("Alarm telemetry needs %d bytes, buffer is %d bytes", JsonWriterRequiredSize(&writer), bufferSize);
 	}
-	else
+	return err;
+}
+
+void TransmitAlarmTelemetry(void)
+{
+	uint8_t alarmCount = 0;
+	azureManagerPriority priority;
+	int len;
+
+	if (AlarmAggregatorPendingCount() == 0)
 	{
-		LOG_INF("Azure is not connected, cannot send telemetry data!");
+		return;
+	}
+
+	//A message with only the heartbeat is periodic traffic, any other alarm type moves it to the alarm queue.
+	//The type decides it rather than the priority, since the priorities can be set freely from the twin
+	priority = AlarmAggregatorTypeCount(ALARM_TYPE_HEARTBEAT) < AlarmAggregatorPendingCount() ?
+		AZURE_MNG_PRIORITY_ALARM : AZURE_MNG_PRIORITY_PERIODIC;
+
+	len = CreateAlarmTelemetry(telemetryBuffer, sizeof(telemetryBuffer), &alarmCount);
+
+	//The alarms are removed even if the message couldn't be created, so one bad alarm can't block the rest
+	AlarmAggregatorClear(alarmCount);
+	heartbeatPending = false;
+
+	if (len < 0)
+	{
+		LOG_ERR("Could not create alarm telemetry, error: %d", len);
+		return;
 	}
+
+	LOG_INF("Sending telemetry with %d alarms", alarmCount);
+
+	//Send the telemetry data, the Azure manager stores it if Azure is not connected
+	AzureManagerSendTelemetry(telemetryBuffer, priority);
 }
 
 
@@ -454,16 +898,10 @@ void TransmitEnergyMeterTelemtry(void)
 {
 	if (azureConnected)
 	{
-		//cJSON* pTelemetryObject = CreateFullAlarmTelemetry();
-		//cJSON* pTelemetryObject = CreateEnertyTelemetry();
-
-		//"Export" the json object to the adcTelemetryBuffer
-		//cJSON_PrintPreallocated(pTelemetryObject, telemetryBuffer, sizeof(telemetryBuffer), false);
-		
-		//cJSON_Delete(pTelemetryObject);
+		//int len = CreateEnergyMeterTelemetry(telemetryBuffer, sizeof(telemetryBuffer));
 	
 		//Send the telemetry data 
-		//AzureManagerSendTelemetry(telemetryBuffer);
+		//AzureManagerSendTelemetry(telemetryBuffer, AZURE_MNG_PRIORITY_PERIODIC);
 	}
 	else
 	{
@@ -476,6 +914,38 @@ void setup()
 	int err;
 
 	
+	BootTimelineMark(BOOT_STAGE_SETUP_START);
+
+	//Azure connection modules initialization
+		//Run provisioning check, this loads the device settings and initializes the modem library.
+		//It has to run before the network attach, credentials can only be written while the modem is offline
+		err = NrfProvisioningAzureRunProvisioningCheck(deviceId, idScope, serialNo, timeToChangeProv, ButtonsHandlerIsPressed(PROVISIONING_BUTTON_ID) == 1);
+		if (err < 0)
+		{
+			LOG_ERR("Provisioning check failed, rebooting device");
+			DeviceRebootError(); //Consider if this always is the best option...
+		}
+		BootTimelineMark(BOOT_STAGE_PROVISIONED);
+
+		//initialize l4 connection manager
+		err = L4ConnectionManagerNetworkInit(L4ConnectionManagerCb);
+		if (err < 0)
+		{
+			LOG_ERR("L4 connection manager initialization failed, rebooting device");
+			DeviceRebootError();
+		}
+
+		//Start the network attach, the rest of the modules are initialized while the modem attaches
+		//The connected event is handled by the main dispatcher
+		err = L4ConnectionManagerNetworkConnectStart();
+		if (err < 0)
+		{
+			LOG_ERR("L4 connection manager network connect failed, rebooting device");
+			DeviceRebootError();
+		}
+		k_timer_start(&networkTimeoutTimer, K_SECONDS(NETWORK_CONNECT_TIMEOUT_S), K_NO_WAIT);
+		BootTimelineMark(BOOT_STAGE_ATTACH_START);
+
 	//GPIO dependent modules initialization
 		//Initialize the button module
 
@@ -489,10 +959,15 @@ void setup()
 
 		
 
-		//Initialize the module for universal alarm inputs
+		//Initialize the alarm aggregator, alarms from all sources are collected into as few messages as possible
+		AlarmAggregatorInit(AlarmAggregatorFlushCb, WriteAlarmObject);
+
+		//Initialize the module for universal alarm inputs, the inputs are set to the stored configuration
 		UniversalAlarmInputInit(UniversalAlarmInputCb);
-		UniversalAlarmInputSetMode(0, UIM_DIGITAL_INPUT_NC);
-		UniversalAlarmInputSetMode(1, UIM_DIGITAL_INPUT_NC);
+
+		//Run the self test, this calibrates the ADC before the sampling is started
+		Pmi8002SelfTestInit();
+		Pmi8002SelfTestStart();
 		UniversalAlarmInputStart();
 
 
@@ -508,40 +983,17 @@ void setup()
 
 		//Initialize the energy meter module
 
-	
+		BootTimelineMark(BOOT_STAGE_LOCAL_INIT);
 
-	//Azure connection modules initialization
-		//Run provisioning check
-		err = NrfProvisioningAzureRunProvisioningCheck(deviceId, idScope, serialNo, timeToChangeProv);
-		if (err < 0)
-		{
-			LOG_ERR("Provisioning check failed, rebooting device");
-			DeviceRebootError(); //Consider if this always is the best option...
-		}
-
-		//Initialize the device settings module
-	
-		//Initialize the device twin module for PAM8053
+	//Azure connection modules initialization, continued while the network attaches
+		//Initialize the device twin module for PAM8053, it starts from the stored input configuration
 		Pam8053AzureDeviceTwinSetup(&pam8053DtStruct, Pam80053AzureDeviceTwinCb);
 
-		//initialize l4 connection manager
-		err = L4ConnectionManagerNetworkInit(L4ConnectionManagerCb);
-		if (err < 0)
-		{
-			LOG_ERR("L4 connection manager initialization failed, rebooting device");
-			DeviceRebootError();
-		}
-
-		//Connect to the network
-		err = L4ConnectionManagerNetworkConnect(300);
-		if (err < 0)
-		{
-			LOG_ERR("L4 connection manager network connect failed, rebooting device");
-			DeviceRebootError();
-		}
-		LOG_INF("L4 connection manager network connect successful");
+		//Direct methods handled outside the Azure manager
+		AzureManagerRegisterDirectMethod("CalibrateAdc", CalibrateAdcMethodCb);
+		AzureManagerRegisterDirectMethod("GetAdcCapture", GetAdcCaptureMethodCb);
 
-		//Initialize the Azure connection manager
+		//Initialize the Azure connection manager, it doesn't need the network until the first connect
 		err = AzureManagerInit(AzureManagerStatusCb, Pam8053DeviceTwinCb, "PAM8002_1040", "0ne008A3851");//deviceId, idScope);
 		if (err < 0)
 		{
@@ -549,6 +1001,7 @@ void setup()
 			DeviceRebootError();
 		}
 		LOG_INF("Azure manager initialization successful");
+		BootTimelineMark(BOOT_STAGE_AZURE_INIT);
 	
 	//Zigbee dependent modules initialization
 	//Initialize the Zigbee manager
@@ -558,66 +1011,190 @@ void setup()
 
 	k_timer_start(&heartbeatTimer, K_SECONDS(heartbeatSendInterval), K_SECONDS(heartbeatSendInterval)); //Start the heartbeat timer with the initial interval
 	k_timer_start(&energyMeterTimer, K_SECONDS(pam8053DtStruct.powerMeterInterval), K_SECONDS(pam8053DtStruct.powerMeterInterval)); //Start the energy meter timer with the initial interval
+	k_timer_start(&thermostatTimer, K_SECONDS(THERMOSTAT_CHECK_INTERVAL_S), K_SECONDS(THERMOSTAT_CHECK_INTERVAL_S));
+	k_timer_start(&wakeupStatsTimer, K_SECONDS(WAKEUP_STATS_INTERVAL_S), K_SECONDS(WAKEUP_STATS_INTERVAL_S));
+}
 
+//Connect to Azure if the network is up and the hub connection isn't
+void CheckAzureConnection(void)
+{
+	int err;
+
+	if (!azureConnected && L4ConnectionManagerStatusGlobal == L4_CNCT_MNG_NETWORK_CONNECTED)
+	{
+		//The connect is asynchronous, the result arrives as an Azure status event
+		err = AzureManagerConnect();
+		if (err == 0) 
+		{
+			LOG_INF("Connecting to Azure...");
+		}
+	}
 }
 
+void CheckThermostat(void)
+{
+	int temperature = ZigbeeManagerGetTemp(1) * 100;
+
+	//A local temperature input is used before the Zigbee sensor
+	for (int i = 0; i < MAX_UIE_INPUTS; i++)
+	{
+		if (inputTemperatureValid[i])
+		{
+			temperature = inputTemperature[i];
+			break;
+		}
+	}
 
+	if(temperature < THERMOSTAT_ON_CENTI)//If the temperature is below 18 degrees Celsius, turn on the heating
+	{
+		LOG_INF("Temperature is below 18 degrees Celsius, turning on the heating");
+		RelayControlRelayOn(1); //Turn on the heating relay
+	} 
+	else if(temperature > THERMOSTAT_OFF_CENTI) //If the temperature is above 22 degrees Celsius, turn off the heating
+	{
+		LOG_INF("Temperature is above 22 degrees Celsius, turning off the heating");
+		RelayControlRelayOff(1); //Turn off the heating relay
+	}
+}
 
+void LogOutboundQueueStats(void)
+{
+	static const char *const queueNames[AZURE_MNG_PRIORITY_COUNT] = {"alarm", "twin report", "periodic"};
+	azureManagerQueueStats stats;
 
-//Main function
-//_____________________________________________________________________________________________________________________
-int main(void)
+	for (int i = 0; i < AZURE_MNG_PRIORITY_COUNT; i++)
+	{
+		AzureManagerGetQueueStats(i, &stats);
+		LOG_INF("Outbound %s queue: depth %d (max %d), sent %d, stored %d, dropped %d, latency avg %d ms max %d ms",
+			queueNames[i], stats.depth, stats.maxDepth, stats.sent, stats.stored, stats.dropped, stats.latencyAvgMs, stats.latencyMaxMs);
+		LOG_INF("Outbound %s queue: acked %d, retransmitted %d, PUBACK latency avg %d ms max %d ms",
+			queueNames[i], stats.acked, stats.retransmitted, stats.ackLatencyAvgMs, stats.ackLatencyMaxMs);
+	}
+}
+
+//Log the time the ADC module spends per sampling cycle
+void LogAdcStats(void)
 {
-	int err;
-	LOG_INF("Starting PAM8053 device, firmware version: %s", CONFIG_AZURE_FOTA_APP_VERSION);
+	AdcDtsStats stats;
 
-	setup(); //Setup the modules
-	k_sleep(K_MSEC(1000)); //Wait for the modules to initialize
+	AdcDtsGetStats(&stats);
+	LOG_INF("ADC %s%s: %d cycles, cycle time last %d us avg %d us max %d us, %d overruns", stats.scanMode ? "scan" : "per channel read",
+		stats.asyncMode ? " (async)" : "", stats.cycles, stats.cycleTimeLastUs, stats.cycleTimeAvgUs, stats.cycleTimeMaxUs, stats.overruns);
+	LOG_INF("ADC sample rate avg %d.%03d Hz, %d burst cycles, %s", stats.sampleRateAvgMilliHz / 1000, stats.sampleRateAvgMilliHz % 1000,
+		stats.burstCycles, stats.burstMode ? "burst" : "idle");
 
-		
-	while(1)
+	LOG_INF("ADC timer jitter min %d us mean %d us max %d us", stats.timerJitter.minUs, stats.timerJitter.meanUs, stats.timerJitter.maxUs);
+	LOG_INF("ADC start latency min %d us mean %d us max %d us", stats.startLatency.minUs, stats.startLatency.meanUs, stats.startLatency.maxUs);
+	LOG_INF("ADC dispatch latency min %d us mean %d us max %d us", stats.dispatchLatency.minUs, stats.dispatchLatency.meanUs, stats.dispatchLatency.maxUs);
+
+	for (int i = 0; i < ADC_DTS_CHANNEL_COUNT; i++)
 	{
+		LOG_INF("ADC channel %d: %d samples, %d events", i, stats.samples[i], stats.events[i]);
+	}
 
-		if (!azureConnected && L4ConnectionManagerStatusGlobal == L4_CNCT_MNG_NETWORK_CONNECTED)
-		{
-			LOG_INF("Connecting to Azure...");
-			err = AzureManagerConnect();
-			if (err < 0 && err != -EALREADY) 
+	for (int i = 0; i < MAX_UIE_INPUTS; i++)
+	{
+		LOG_INF("Input %d: %d transitions suppressed by the debounce", i, UniversalAlarmInputGetSuppressedCount(i));
+	}
+}
+
+//Handle a single event taken from the main event queue
+void DispatchMainEvent(const MainEvent* event)
+{
+	switch (event->type)
+	{
+		case MAIN_EVT_CONNECTIVITY_CHECK:
+			CheckAzureConnection();
+		break;
+
+		case MAIN_EVT_L4_STATUS:
+			L4ConnectionManagerStatusGlobal = event->data.l4Status;
+			LOG_INF("networkStatusGlobal has value: %d",L4ConnectionManagerStatusGlobal);
+			AzureManagerSetNetworkConnected(L4ConnectionManagerStatusGlobal == L4_CNCT_MNG_NETWORK_CONNECTED);
+			CheckAzureConnection();
+		break;
+
+		case MAIN_EVT_AZURE_STATUS:
+			//Reconnects are handled by the Azure manager connection supervisor
+			azureConnected = event->data.azureStatus == AZURE_MNG_NETWORK_CONNECTED ? true : false;
+			LOG_INF("azureConnected has value: %s", azureConnected ? "true" : "false");
+		break;
+
+		case MAIN_EVT_HEARTBEAT_TIMER:
+			QueueHeartbeatAlarm();
+			LOG_INF("Heartbeat telemetry queued, waiting for next interval of %ds", pam8053DtStruct.heartbeatInterval);
+		break;
+
+		case MAIN_EVT_ENERGY_METER_TIMER:
+			TransmitEnergyMeterTelemtry();
+			LOG_INF("Energy meter reading sent, waiting for next interval of %ds", pam8053DtStruct.powerMeterInterval);
+		break;
+
+		case MAIN_EVT_THERMOSTAT_TIMER:
+			CheckThermostat();
+		break;
+
+		case MAIN_EVT_INPUT:
+			HandleUniversalAlarmInputEvent(&event->data.input);
+		break;
+
+		case MAIN_EVT_CODE_PANEL:
+			HandleCodePanelEvent(&event->data.codePanel);
+		break;
+
+		case MAIN_EVT_ALARM_FLUSH:
+			TransmitAlarmTelemetry();
+		break;
+
+		case MAIN_EVT_NETWORK_TIMEOUT:
+			if (L4ConnectionManagerStatusGlobal != L4_CNCT_MNG_NETWORK_CONNECTED)
 			{
-				LOG_ERR("Could not connect to Azure ");
+				LOG_ERR("Network not connected %ds after boot, rebooting device", NETWORK_CONNECT_TIMEOUT_S);
 				DeviceRebootError();
 			}
-		}
-		
-		if (transmitHeartbeatTelemetry)
-		{
-			TransmitHeartbeatTelemetry();
-			LOG_INF("Heartbeat telemetry sent, waiting for next interval of %ds", pam8053DtStruct.heartbeatInterval);
-			transmitHeartbeatTelemetry = false; //Reset the flag
-		}
+		break;
 
+		case MAIN_EVT_SAVE_INPUT_CONFIG:
+			//Stored so the inputs come up with the twin configuration before the cloud connects
+			UniversalAlarmInputSaveConfig();
+		break;
+
+		case MAIN_EVT_WAKEUP_STATS:
+			LOG_INF("Main dispatcher wakeups during the last %ds: %d", WAKEUP_STATS_INTERVAL_S, dispatcherWakeups);
+			dispatcherWakeups = 0;
+			LogOutboundQueueStats();
+			LogAdcStats();
+		break;
+
+		default:
+			LOG_WRN("Unhandled main event type %d", event->type);
+		break;
+	}
+}
 
 
-		if (transmitEnergyMeterReading)
-		{
-			TransmitEnergyMeterTelemtry();
-			LOG_INF("Energy meter reading sent, waiting for next interval of %ds", pam8053DtStruct.powerMeterInterval);
-			transmitEnergyMeterReading = false; //Reset the flag
-		}
 
-		if(ZigbeeManagerGetTemp(1) < 18.0)//If the temperature is below 18 degrees Celsius, turn on the heating
-		{
-			LOG_INF("Temperature is below 18 degrees Celsius, turning on the heating");
-			RelayControlRelayOn(1); //Turn on the heating relay
-		} 
-		else if(ZigbeeManagerGetTemp(1) > 22.0) //If the temperature is above 22 degrees Celsius, turn off the heating
-		{
-			LOG_INF("Temperature is above 22 degrees Celsius, turning off the heating");
-			RelayControlRelayOff(1); //Turn off the heating relay
-		}
 
+//Main function
+//_____________________________________________________________________________________________________________________
+int main(void)
+{
+	MainEvent event;
+
+	LOG_INF("Starting PAM8053 device, firmware version: %s", CONFIG_AZURE_FOTA_APP_VERSION);
+
+	setup(); //Setup the modules
+
+	//The L4 connected event may have been handled before Azure was initialized, so check the connection once
+	MainEventPost(MAIN_EVT_CONNECTIVITY_CHECK);
+
+	//The main thread only wakes up when a timer or a module posts an event
+	while(1)
+	{
+		k_msgq_get(&mainEventMsgq, &event, K_FOREVER);
+		dispatcherWakeups++;
 
-		k_sleep(K_MSEC(1000));	
+		DispatchMainEvent(&event);
 	}
 		
 	return 0;
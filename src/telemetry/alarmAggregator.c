@@ -0,0 +1,169 @@
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+
+#include "alarmAggregator.h"
+
+LOG_MODULE_REGISTER(alarmAggregator, LOG_LEVEL_INF);
+
+typedef struct
+{
+	Alarm alarm;
+	uint8_t alarmChannel;
+	size_t bytes;
+} PendingAlarm;
+
+static PendingAlarm pendingAlarms[ALARM_AGGREGATOR_MAX_ALARMS];
+static uint8_t pendingCount;
+static size_t pendingBytes;
+
+static AlarmAggregatorFlushCb pFlushHandler;
+static AlarmAggregatorWriteFunc pWriteFunc;
+
+static K_MUTEX_DEFINE(aggregatorMutex);
+
+void windowTimerCb(struct k_timer *timer);
+K_TIMER_DEFINE(windowTimer, windowTimerCb, NULL); //This timer closes the coalescing window of the pending message
+
+void windowTimerCb(struct k_timer *timer)
+{
+	if (pFlushHandler != NULL)
+	{
+		(*pFlushHandler)();
+	}
+}
+
+//Size of the alarm object, including the separating comma, found by running the writer without a buffer
+static size_t AlarmObjectSize(const Alarm *pAlarm, uint8_t alarmChannel)
+{
+	JsonWriter writer;
+
+	JsonWriterInit(&writer, NULL, 0);
+	JsonWriterArrayStart(&writer, NULL);
+	(*pWriteFunc)(&writer, pAlarm, alarmChannel);
+
+	//The array start character is counted as the comma in front of the object
+	return writer.length;
+}
+
+void AlarmAggregatorInit(AlarmAggregatorFlushCb flushHandler, AlarmAggregatorWriteFunc writeFunc)
+{
+	pFlushHandler = flushHandler;
+	pWriteFunc = writeFunc;
+	pendingCount = 0;
+	pendingBytes = 0;
+}
+
+int AlarmAggregatorAdd(const Alarm *pAlarm, uint8_t alarmChannel)
+{
+	size_t alarmBytes;
+	bool flushNow;
+
+	if (pWriteFunc == NULL)
+	{
+		LOG_ERR("Alarm aggregator isn't initialized");
+		return -ENODEV;
+	}
+
+	alarmBytes = AlarmObjectSize(pAlarm, alarmChannel);
+
+	k_mutex_lock(&aggregatorMutex, K_FOREVER);
+
+	if (pendingCount > 0 && (pendingCount >= ALARM_AGGREGATOR_MAX_ALARMS || pendingBytes + alarmBytes > ALARM_AGGREGATOR_MAX_BYTES))
+	{
+		k_mutex_unlock(&aggregatorMutex);
+		LOG_DBG("Alarm doesn't fit in the pending message (%d alarms, %d bytes)", pendingCount, pendingBytes);
+		return -ENOMEM;
+	}
+
+	pendingAlarms[pendingCount].alarm = *pAlarm;
+	pendingAlarms[pendingCount].alarmChannel = alarmChannel;
+	pendingAlarms[pendingCount].bytes = alarmBytes;
+	pendingCount++;
+	pendingBytes += alarmBytes;
+
+	//The window starts with the first alarm, later alarms are sent together with it
+	if (pendingCount == 1)
+	{
+		k_timer_start(&windowTimer, K_MSEC(ALARM_AGGREGATOR_WINDOW_MS), K_NO_WAIT);
+	}
+
+	flushNow = pAlarm->priority <= ALARM_AGGREGATOR_HIGH_PRIORITY_LEVEL || pendingCount >= ALARM_AGGREGATOR_MAX_ALARMS;
+
+	LOG_DBG("Alarm %s added, %d alarms and %d bytes pending", pAlarm->alarmId, pendingCount, pendingBytes);
+
+	k_mutex_unlock(&aggregatorMutex);
+
+	if (flushNow)
+	{
+		k_timer_stop(&windowTimer);
+		if (pFlushHandler != NULL)
+		{
+			(*pFlushHandler)();
+		}
+	}
+	return 0;
+}
+
+uint8_t AlarmAggregatorWrite(JsonWriter *pWriter)
+{
+	uint8_t written;
+
+	k_mutex_lock(&aggregatorMutex, K_FOREVER);
+
+	for (written = 0; written < pendingCount; written++)
+	{
+		(*pWriteFunc)(pWriter, &pendingAlarms[written].alarm, pendingAlarms[written].alarmChannel);
+	}
+
+	k_mutex_unlock(&aggregatorMutex);
+	return written;
+}
+
+void AlarmAggregatorClear(uint8_t count)
+{
+	k_mutex_lock(&aggregatorMutex, K_FOREVER);
+
+	count = MIN(count, pendingCount);
+	k_timer_stop(&windowTimer);
+
+	//Alarms added after the message was written are kept for the next message
+	memmove(&pendingAlarms[0], &pendingAlarms[count], (pendingCount - count) * sizeof(PendingAlarm));
+	pendingCount -= count;
+
+	pendingBytes = 0;
+	for (uint8_t i = 0; i < pendingCount; i++)
+	{
+		pendingBytes += pendingAlarms[i].bytes;
+	}
+
+	if (pendingCount > 0)
+	{
+		k_timer_start(&windowTimer, K_MSEC(ALARM_AGGREGATOR_WINDOW_MS), K_NO_WAIT);
+	}
+
+	k_mutex_unlock(&aggregatorMutex);
+}
+
+uint8_t AlarmAggregatorPendingCount(void)
+{
+	return pendingCount;
+}
+
+uint8_t AlarmAggregatorTypeCount(uint8_t type)
+{
+	uint8_t count = 0;
+
+	k_mutex_lock(&aggregatorMutex, K_FOREVER);
+
+	for (uint8_t i = 0; i < pendingCount; i++)
+	{
+		if (pendingAlarms[i].alarm.type == type)
+		{
+			count++;
+		}
+	}
+
+	k_mutex_unlock(&aggregatorMutex);
+	return count;
+}
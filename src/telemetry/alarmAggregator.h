@@ -0,0 +1,61 @@
+#ifndef ALARM_AGGREGATOR_H
+#define ALARM_AGGREGATOR_H
+
+//Global macros used by the .c module which needs to easily be modified by the user
+#define ALARM_AGGREGATOR_MAX_ALARMS          8    //Maximum number of alarms in one telemetry message
+#define ALARM_AGGREGATOR_MAX_BYTES           768  //Byte budget for the alarms array in one telemetry message
+#define ALARM_AGGREGATOR_WINDOW_MS           2000 //Time to wait for more alarms before the message is sent
+#define ALARM_AGGREGATOR_HIGH_PRIORITY_LEVEL 2    //Alarms with this priority or lower (more important) are sent at once
+
+//Include libraries needed for the header to compile, often simple libraries like inttypes.h
+#include <inttypes.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "jsonWriter.h"
+
+//Global variables that needs to be accessed outside the modules scope
+typedef struct 
+{
+    char alarmId[64]; 			
+    char name[64]; 				
+    char text[64]; 				
+    char eventTimestamp[32];
+    uint8_t type; 				
+    uint8_t priority;
+} Alarm;
+
+//Called when the pending alarms should be sent, can be called from ISR context (coalescing timer)
+typedef void(*AlarmAggregatorFlushCb)(void);
+
+//Writes a single alarm as an element in the alarms array
+typedef void(*AlarmAggregatorWriteFunc)(JsonWriter *pWriter, const Alarm *pAlarm, uint8_t alarmChannel);
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+//Functions that should be accessible from the outside 
+void AlarmAggregatorInit(AlarmAggregatorFlushCb flushHandler, AlarmAggregatorWriteFunc writeFunc);
+
+//Add an alarm to the pending message. Returns -ENOMEM if the alarm doesn't fit in the current message,
+//the pending alarms should then be sent before the alarm is added again
+int AlarmAggregatorAdd(const Alarm *pAlarm, uint8_t alarmChannel);
+
+//Write the pending alarms as elements in an array that has already been started by the caller.
+//Returns the number of alarms written
+uint8_t AlarmAggregatorWrite(JsonWriter *pWriter);
+
+//Remove the first count alarms, call this when they have been written and handed to the Azure manager
+void AlarmAggregatorClear(uint8_t count);
+
+uint8_t AlarmAggregatorPendingCount(void);
+
+//Returns the number of pending alarms of the given type
+uint8_t AlarmAggregatorTypeCount(uint8_t type);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //ALARM_AGGREGATOR_H
@@ -0,0 +1,70 @@
+#include <zephyr/kernel.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/logging/log.h>
+
+#include "bootTimeline.h"
+
+LOG_MODULE_REGISTER(bootTimeline, LOG_LEVEL_INF);
+
+static const char *const stageNames[BOOT_STAGE_COUNT] =
+{
+	[BOOT_STAGE_SETUP_START] = "setupStart",
+	[BOOT_STAGE_LOCAL_INIT] = "localInit",
+	[BOOT_STAGE_PROVISIONED] = "provisioned",
+	[BOOT_STAGE_ATTACH_START] = "attachStart",
+	[BOOT_STAGE_AZURE_INIT] = "azureInit",
+	[BOOT_STAGE_NETWORK_CONNECTED] = "networkConnected",
+	[BOOT_STAGE_HUB_CONNECTED] = "hubConnected",
+	[BOOT_STAGE_FIRST_PUBLISH] = "firstPublish",
+};
+
+//Stamps are written once from different threads, 0 means the stage hasn't been reached
+static atomic_t stageStamps[BOOT_STAGE_COUNT];
+static atomic_t reported;
+
+void BootTimelineMark(BootStage stage)
+{
+	int64_t now = k_uptime_get();
+
+	if (stage >= BOOT_STAGE_COUNT)
+	{
+		return;
+	}
+
+	//Uptime is stored + 1 so a stage reached at 0 ms can be told apart from an unset one
+	if (atomic_cas(&stageStamps[stage], 0, (atomic_val_t)(now + 1)))
+	{
+		LOG_INF("Boot stage %s reached at %lld ms", stageNames[stage], now);
+	}
+}
+
+int64_t BootTimelineGet(BootStage stage)
+{
+	atomic_val_t stamp;
+
+	if (stage >= BOOT_STAGE_COUNT)
+	{
+		return -EINVAL;
+	}
+
+	stamp = atomic_get(&stageStamps[stage]);
+	if (stamp == 0)
+	{
+		return -ENOENT;
+	}
+	return (int64_t)stamp - 1;
+}
+
+const char *BootTimelineStageName(BootStage stage)
+{
+	if (stage >= BOOT_STAGE_COUNT)
+	{
+		return "unknown";
+	}
+	return stageNames[stage];
+}
+
+bool BootTimelineTakeReport(void)
+{
+	return atomic_cas(&reported, 0, 1);
+}
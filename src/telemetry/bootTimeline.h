@@ -0,0 +1,47 @@
+#ifndef BOOT_TIMELINE_H
+#define BOOT_TIMELINE_H
+
+//Global macros used by the .c module which needs to easily be modified by the user
+#define BOOT_TIMELINE_KEY "bootTimeline" //Name of the object in the twin report
+
+//Include libraries needed for the header to compile, often simple libraries like inttypes.h
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+//Global variables that needs to be accessed outside the modules scope
+typedef enum
+{
+	BOOT_STAGE_SETUP_START,
+	BOOT_STAGE_LOCAL_INIT,
+	BOOT_STAGE_PROVISIONED,
+	BOOT_STAGE_ATTACH_START,
+	BOOT_STAGE_AZURE_INIT,
+	BOOT_STAGE_NETWORK_CONNECTED,
+	BOOT_STAGE_HUB_CONNECTED,
+	BOOT_STAGE_FIRST_PUBLISH,
+	BOOT_STAGE_COUNT
+} BootStage;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+//Functions that should be accessible from the outside 
+
+//Store the uptime of a boot stage, only the first time a stage is reached is kept so reconnects don't move the stamps
+void BootTimelineMark(BootStage stage);
+
+//Returns the uptime in ms when the stage was reached, -ENOENT if it hasn't been reached
+int64_t BootTimelineGet(BootStage stage);
+
+//Name of the stage used in the log and the twin report
+const char *BootTimelineStageName(BootStage stage);
+
+//Returns true the first time it is called, the timeline is only included in the first twin report
+bool BootTimelineTakeReport(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //BOOT_TIMELINE_H
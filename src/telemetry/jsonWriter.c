@@ -0,0 +1,229 @@
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#include "jsonWriter.h"
+
+//Writes one character, characters beyond the buffer are only counted
+static void PutChar(JsonWriter *pWriter, char c)
+{
+	//One byte is always kept free for the null terminator
+	if (pWriter->length + 1 < pWriter->bufferSize)
+	{
+		pWriter->pBuffer[pWriter->length] = c;
+	}
+	pWriter->length++;
+}
+
+static void PutRaw(JsonWriter *pWriter, const char *str)
+{
+	while (*str != '\0')
+	{
+		PutChar(pWriter, *str++);
+	}
+}
+
+static void PutEscapedString(JsonWriter *pWriter, const char *str)
+{
+	static const char hexDigits[] = "0123456789abcdef";
+
+	PutChar(pWriter, '"');
+	while (*str != '\0')
+	{
+		unsigned char c = (unsigned char)*str++;
+
+		switch (c)
+		{
+			case '"':
+				PutRaw(pWriter, "\\\"");
+			break;
+
+			case '\\':
+				PutRaw(pWriter, "\\\\");
+			break;
+
+			case '\n':
+				PutRaw(pWriter, "\\n");
+			break;
+
+			case '\r':
+				PutRaw(pWriter, "\\r");
+			break;
+
+			case '\t':
+				PutRaw(pWriter, "\\t");
+			break;
+
+			default:
+				if (c < 0x20)
+				{
+					PutRaw(pWriter, "\\u00");
+					PutChar(pWriter, hexDigits[c >> 4]);
+					PutChar(pWriter, hexDigits[c & 0x0F]);
+				}
+				else
+				{
+					PutChar(pWriter, (char)c);
+				}
+			break;
+		}
+	}
+	PutChar(pWriter, '"');
+}
+
+//Writes the separator and key in front of a new value
+static void BeginValue(JsonWriter *pWriter, const char *key)
+{
+	if (pWriter->hasMembers[pWriter->depth])
+	{
+		PutChar(pWriter, ',');
+	}
+	pWriter->hasMembers[pWriter->depth] = true;
+
+	//Array elements and the root value have no key
+	if (pWriter->depth == 0 || pWriter->inArray[pWriter->depth])
+	{
+		return;
+	}
+
+	if (key == NULL)
+	{
+		pWriter->error = true;
+		return;
+	}
+	PutEscapedString(pWriter, key);
+	PutChar(pWriter, ':');
+}
+
+static void OpenContainer(JsonWriter *pWriter, const char *key, char open)
+{
+	BeginValue(pWriter, key);
+	PutChar(pWriter, open);
+
+	if (pWriter->depth + 1 >= JSON_WRITER_MAX_DEPTH)
+	{
+		pWriter->error = true;
+		return;
+	}
+	pWriter->depth++;
+	pWriter->hasMembers[pWriter->depth] = false;
+	pWriter->inArray[pWriter->depth] = open == '[';
+}
+
+static void CloseContainer(JsonWriter *pWriter, char close)
+{
+	//Closing another type of container than the one opened is a nesting error as well
+	if (pWriter->depth == 0 || pWriter->inArray[pWriter->depth] != (close == ']'))
+	{
+		pWriter->error = true;
+		return;
+	}
+	pWriter->depth--;
+	PutChar(pWriter, close);
+}
+
+void JsonWriterInit(JsonWriter *pWriter, char *pBuffer, size_t bufferSize)
+{
+	memset(pWriter, 0, sizeof(*pWriter));
+	pWriter->pBuffer = pBuffer;
+	pWriter->bufferSize = bufferSize;
+}
+
+void JsonWriterObjectStart(JsonWriter *pWriter, const char *key)
+{
+	OpenContainer(pWriter, key, '{');
+}
+
+void JsonWriterObjectEnd(JsonWriter *pWriter)
+{
+	CloseContainer(pWriter, '}');
+}
+
+void JsonWriterArrayStart(JsonWriter *pWriter, const char *key)
+{
+	OpenContainer(pWriter, key, '[');
+}
+
+void JsonWriterArrayEnd(JsonWriter *pWriter)
+{
+	CloseContainer(pWriter, ']');
+}
+
+void JsonWriterAddString(JsonWriter *pWriter, const char *key, const char *value)
+{
+	BeginValue(pWriter, key);
+	PutEscapedString(pWriter, value != NULL ? value : "");
+}
+
+void JsonWriterAddInt(JsonWriter *pWriter, const char *key, int32_t value)
+{
+	char numberBuf[12];
+
+	BeginValue(pWriter, key);
+	snprintf(numberBuf, sizeof(numberBuf), "%" PRId32, value);
+	PutRaw(pWriter, numberBuf);
+}
+
+void JsonWriterAddBool(JsonWriter *pWriter, const char *key, bool value)
+{
+	BeginValue(pWriter, key);
+	PutRaw(pWriter, value ? "true" : "false");
+}
+
+void JsonWriterAddDecimal(JsonWriter *pWriter, const char *key, int32_t scaledValue, uint8_t decimals)
+{
+	char numberBuf[24];
+	uint32_t divisor = 1;
+	uint32_t absValue;
+
+	if (decimals == 0)
+	{
+		JsonWriterAddInt(pWriter, key, scaledValue);
+		return;
+	}
+
+	//A 32 bit value can't hold more than 9 decimals
+	if (decimals > 9)
+	{
+		decimals = 9;
+	}
+
+	for (uint8_t i = 0; i < decimals; i++)
+	{
+		divisor *= 10;
+	}
+
+	//The sign is handled separately, so values between -1 and 0 keep their sign
+	absValue = scaledValue < 0 ? (uint32_t)(-(int64_t)scaledValue) : (uint32_t)scaledValue;
+
+	BeginValue(pWriter, key);
+	snprintf(numberBuf, sizeof(numberBuf), "%s%" PRIu32 ".%0*" PRIu32, scaledValue < 0 ? "-" : "",
+		absValue / divisor, (int)decimals, absValue % divisor);
+	PutRaw(pWriter, numberBuf);
+}
+
+int JsonWriterFinish(JsonWriter *pWriter)
+{
+	if (pWriter->bufferSize > 0)
+	{
+		size_t end = pWriter->length < pWriter->bufferSize ? pWriter->length : pWriter->bufferSize - 1;
+		pWriter->pBuffer[end] = '\0';
+	}
+
+	if (pWriter->error || pWriter->depth != 0)
+	{
+		return -EINVAL;
+	}
+
+	if (pWriter->length + 1 > pWriter->bufferSize)
+	{
+		return -ENOMEM;
+	}
+
+	return (int)pWriter->length;
+}
+
+size_t JsonWriterRequiredSize(const JsonWriter *pWriter)
+{
+	return pWriter->length + 1;
+}
@@ -0,0 +1,58 @@
+#ifndef JSON_WRITER_H
+#define JSON_WRITER_H
+
+//Global macros used by the .c module which needs to easily be modified by the user
+#define JSON_WRITER_MAX_DEPTH 8 //Maximum nesting of objects and arrays
+
+//Include libraries needed for the header to compile, often simple libraries like inttypes.h
+#include <inttypes.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+//Global variables that needs to be accessed outside the modules scope
+//Streaming JSON writer that emits directly into a caller provided buffer without using the heap.
+//The writer keeps counting when the buffer is full, so the required size is known after an overflow.
+typedef struct
+{
+	char *pBuffer;
+	size_t bufferSize;
+	size_t length; //Number of characters the document needs, can be larger than bufferSize
+	uint8_t depth;
+	bool hasMembers[JSON_WRITER_MAX_DEPTH]; //True when a comma is needed before the next member at this depth
+	bool inArray[JSON_WRITER_MAX_DEPTH]; //True when the container at this depth is an array, keys are only written in objects
+	bool error; //Set on nesting errors, the document is then invalid
+} JsonWriter;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+//Functions that should be accessible from the outside 
+void JsonWriterInit(JsonWriter *pWriter, char *pBuffer, size_t bufferSize);
+
+//The key is ignored (use NULL) when the value is added to an array or is the root object.
+//A member of an object without a key makes the document invalid
+void JsonWriterObjectStart(JsonWriter *pWriter, const char *key);
+void JsonWriterObjectEnd(JsonWriter *pWriter);
+
+void JsonWriterArrayStart(JsonWriter *pWriter, const char *key);
+void JsonWriterArrayEnd(JsonWriter *pWriter);
+
+void JsonWriterAddString(JsonWriter *pWriter, const char *key, const char *value);
+void JsonWriterAddInt(JsonWriter *pWriter, const char *key, int32_t value);
+void JsonWriterAddBool(JsonWriter *pWriter, const char *key, bool value);
+
+//Adds a fixed point number, e.g. scaledValue -105 with 1 decimal is written as -10.5
+void JsonWriterAddDecimal(JsonWriter *pWriter, const char *key, int32_t scaledValue, uint8_t decimals);
+
+//Terminates the document. Returns the length of the string, or -ENOMEM if the buffer was too small
+//in which case JsonWriterRequiredSize tells how large the buffer must be
+int JsonWriterFinish(JsonWriter *pWriter);
+
+size_t JsonWriterRequiredSize(const JsonWriter *pWriter);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //JSON_WRITER_H
@@ -0,0 +1,320 @@
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/storage/flash_map.h>
+#include <zephyr/fs/fcb.h>
+
+#include "telemetryStore.h"
+
+LOG_MODULE_REGISTER(telemetryStore, LOG_LEVEL_INF);
+
+#if FIXED_PARTITION_EXISTS(TELEMETRY_STORE_PARTITION)
+
+#define TELEMETRY_STORE_PARTITION_ID FIXED_PARTITION_ID(TELEMETRY_STORE_PARTITION)
+
+//Header stored in front of every message in the FCB entry
+typedef struct
+{
+	int64_t timestampMs;
+	uint8_t priority;
+} TelemetryStoreHeader;
+
+static struct fcb storeFcb;
+static struct flash_sector storeSectors[TELEMETRY_STORE_MAX_SECTORS];
+
+//Last entry handed out by TelemetryStorePeek and the last entry removed by TelemetryStorePop
+static struct fcb_entry peekLoc;
+static struct fcb_entry readLoc;
+static bool peekValid;
+
+static uint32_t entryCount;
+static bool storeReady;
+
+static K_MUTEX_DEFINE(storeMutex);
+
+//Count the entries already in flash, the entries are kept across reboots
+static uint32_t CountEntries(void)
+{
+	struct fcb_entry loc = {0};
+	uint32_t count = 0;
+
+	while (fcb_getnext(&storeFcb, &loc) == 0)
+	{
+		count++;
+	}
+	return count;
+}
+
+static int AppendEntry(const TelemetryStoreHeader *pHeader, const char *pMessage, size_t length)
+{
+	struct fcb_entry loc;
+	int err;
+
+	err = fcb_append(&storeFcb, sizeof(*pHeader) + length, &loc);
+	if (err)
+	{
+		return err;
+	}
+
+	err = flash_area_write(storeFcb.fap, FCB_ENTRY_FA_DATA_OFF(loc), pHeader, sizeof(*pHeader));
+	if (err)
+	{
+		return err;
+	}
+
+	err = flash_area_write(storeFcb.fap, FCB_ENTRY_FA_DATA_OFF(loc) + sizeof(*pHeader), pMessage, length);
+	if (err)
+	{
+		return err;
+	}
+
+	return fcb_append_finish(&storeFcb, &loc);
+}
+
+int TelemetryStoreInit(void)
+{
+	uint32_t sectorCount = ARRAY_SIZE(storeSectors);
+	int err;
+
+	if (storeReady)
+	{
+		return -EALREADY;
+	}
+
+	err = flash_area_get_sectors(TELEMETRY_STORE_PARTITION_ID, &sectorCount, storeSectors);
+	if (err)
+	{
+		LOG_ERR("Could not get the sectors of the telemetry store partition, error: %d", err);
+		return err;
+	}
+
+	storeFcb.f_magic = TELEMETRY_STORE_MAGIC;
+	storeFcb.f_version = 1;
+	storeFcb.f_sector_cnt = sectorCount;
+	storeFcb.f_scratch_cnt = 0;
+	storeFcb.f_sectors = storeSectors;
+
+	err = fcb_init(TELEMETRY_STORE_PARTITION_ID, &storeFcb);
+	if (err)
+	{
+		const struct flash_area *pArea;
+
+		LOG_WRN("Telemetry store could not be loaded (error: %d), erasing it", err);
+
+		//A corrupt or old format store is erased and initialized again
+		err = flash_area_open(TELEMETRY_STORE_PARTITION_ID, &pArea);
+		if (err == 0)
+		{
+			err = flash_area_erase(pArea, 0, pArea->fa_size);
+			flash_area_close(pArea);
+		}
+
+		if (err == 0)
+		{
+			err = fcb_init(TELEMETRY_STORE_PARTITION_ID, &storeFcb);
+		}
+
+		if (err)
+		{
+			LOG_ERR("Telemetry store could not be initialized, error: %d", err);
+			return err;
+		}
+	}
+
+	entryCount = CountEntries();
+	memset(&readLoc, 0, sizeof(readLoc));
+	peekValid = false;
+	storeReady = true;
+
+	LOG_INF("Telemetry store initialized with %d sectors, %d messages pending", sectorCount, entryCount);
+	return 0;
+}
+
+int TelemetryStoreAppend(const char *pMessage, size_t length, int64_t timestampMs, uint8_t priority)
+{
+	TelemetryStoreHeader header =
+	{
+		.timestampMs = timestampMs,
+		.priority = priority
+	};
+	int err;
+
+	if (!storeReady)
+	{
+		return -ENODEV;
+	}
+
+	k_mutex_lock(&storeMutex, K_FOREVER);
+
+	err = AppendEntry(&header, pMessage, length);
+	if (err == -ENOSPC)
+	{
+		//The store is full, the oldest sector is dropped to make room for the newest message
+		LOG_WRN("Telemetry store full, dropping the oldest messages");
+
+		if (readLoc.fe_sector == storeFcb.f_oldest)
+		{
+			memset(&readLoc, 0, sizeof(readLoc));
+		}
+		peekValid = false;
+
+		err = fcb_rotate(&storeFcb);
+		if (err == 0)
+		{
+			entryCount = CountEntries();
+			err = AppendEntry(&header, pMessage, length);
+		}
+	}
+
+	if (err == 0)
+	{
+		entryCount++;
+		LOG_DBG("Message of %d bytes stored, %d messages pending", length, entryCount);
+	}
+	else
+	{
+		LOG_ERR("Could not store message, error: %d", err);
+	}
+
+	k_mutex_unlock(&storeMutex);
+	return err;
+}
+
+int TelemetryStorePeek(char *pBuffer, size_t bufferSize, int64_t *pTimestampMs, uint8_t *pPriority)
+{
+	TelemetryStoreHeader header;
+	struct fcb_entry loc;
+	size_t length;
+	int err;
+
+	if (!storeReady)
+	{
+		return -ENODEV;
+	}
+
+	k_mutex_lock(&storeMutex, K_FOREVER);
+
+	loc = readLoc;
+	err = fcb_getnext(&storeFcb, &loc);
+	if (err)
+	{
+		//Everything has been read, start from a clean store so the read position doesn't need to be kept
+		if (readLoc.fe_sector != NULL)
+		{
+			fcb_clear(&storeFcb);
+			memset(&readLoc, 0, sizeof(readLoc));
+		}
+		entryCount = 0;
+		peekValid = false;
+		k_mutex_unlock(&storeMutex);
+		return -ENOENT;
+	}
+
+	length = loc.fe_data_len - sizeof(header);
+	if (loc.fe_data_len < sizeof(header) || length + 1 > bufferSize)
+	{
+		LOG_ERR("Stored message of %d bytes doesn't fit in the buffer, it is skipped", loc.fe_data_len);
+		peekLoc = loc;
+		peekValid = true;
+		k_mutex_unlock(&storeMutex);
+		TelemetryStorePop();
+		return -EMSGSIZE;
+	}
+
+	err = flash_area_read(storeFcb.fap, FCB_ENTRY_FA_DATA_OFF(loc), &header, sizeof(header));
+	if (err == 0)
+	{
+		err = flash_area_read(storeFcb.fap, FCB_ENTRY_FA_DATA_OFF(loc) + sizeof(header), pBuffer, length);
+	}
+
+	if (err)
+	{
+		LOG_ERR("Could not read stored message, error: %d", err);
+		k_mutex_unlock(&storeMutex);
+		return err;
+	}
+
+	pBuffer[length] = '\0';
+	if (pTimestampMs != NULL)
+	{
+		*pTimestampMs = header.timestampMs;
+	}
+	if (pPriority != NULL)
+	{
+		*pPriority = header.priority;
+	}
+
+	peekLoc = loc;
+	peekValid = true;
+
+	k_mutex_unlock(&storeMutex);
+	return length;
+}
+
+int TelemetryStorePop(void)
+{
+	if (!storeReady)
+	{
+		return -ENODEV;
+	}
+
+	k_mutex_lock(&storeMutex, K_FOREVER);
+
+	if (!peekValid)
+	{
+		k_mutex_unlock(&storeMutex);
+		return -ENOENT;
+	}
+
+	//When the read position moves on to a new sector, the oldest sector has been fully sent and can be erased
+	if (readLoc.fe_sector != NULL && readLoc.fe_sector != peekLoc.fe_sector)
+	{
+		fcb_rotate(&storeFcb);
+	}
+
+	readLoc = peekLoc;
+	peekValid = false;
+
+	if (entryCount > 0)
+	{
+		entryCount--;
+	}
+
+	k_mutex_unlock(&storeMutex);
+	return 0;
+}
+
+uint32_t TelemetryStoreCount(void)
+{
+	return entryCount;
+}
+
+#else
+
+int TelemetryStoreInit(void)
+{
+	LOG_WRN("No telemetry store partition, telemetry created while offline is dropped");
+	return -ENOTSUP;
+}
+
+int TelemetryStoreAppend(const char *pMessage, size_t length, int64_t timestampMs, uint8_t priority)
+{
+	return -ENOTSUP;
+}
+
+int TelemetryStorePeek(char *pBuffer, size_t bufferSize, int64_t *pTimestampMs, uint8_t *pPriority)
+{
+	return -ENOENT;
+}
+
+int TelemetryStorePop(void)
+{
+	return -ENOENT;
+}
+
+uint32_t TelemetryStoreCount(void)
+{
+	return 0;
+}
+
+#endif //FIXED_PARTITION_EXISTS(TELEMETRY_STORE_PARTITION)
@@ -0,0 +1,42 @@
+#ifndef TELEMETRY_STORE_H
+#define TELEMETRY_STORE_H
+
+//Global macros used by the .c module which needs to easily be modified by the user
+//Flash partition used for the store, declared in the partition layout of the board (pm_static.yml). Without the
+//partition the store isn't built in, and telemetry created while offline is dropped
+#define TELEMETRY_STORE_PARTITION telemetry_storage
+#define TELEMETRY_STORE_MAX_SECTORS 8
+#define TELEMETRY_STORE_MAGIC 0x544C4D32 //"TLM2", change this if the entry format changes
+
+//Include libraries needed for the header to compile, often simple libraries like inttypes.h
+#include <inttypes.h>
+#include <stddef.h>
+#include <stdint.h>
+
+//Global variables that needs to be accessed outside the modules scope
+//Flash backed FIFO of serialized telemetry messages, used while the device is offline.
+//Each entry keeps the time the message was created so it can be reported when it is sent later, and the
+//priority it was sent with so alarms keep their delivery guarantee.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+//Functions that should be accessible from the outside 
+int TelemetryStoreInit(void);
+
+//Append a message to the end of the FIFO. If the store is full the oldest sector is dropped
+int TelemetryStoreAppend(const char *pMessage, size_t length, int64_t timestampMs, uint8_t priority);
+
+//Read the oldest message without removing it. Returns the length of the message or -ENOENT if the store is empty
+int TelemetryStorePeek(char *pBuffer, size_t bufferSize, int64_t *pTimestampMs, uint8_t *pPriority);
+
+//Remove the message returned by the last call to TelemetryStorePeek, call this when the message has been delivered
+int TelemetryStorePop(void);
+
+uint32_t TelemetryStoreCount(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //TELEMETRY_STORE_H
@@ -0,0 +1,30 @@
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+
+#include "pam8053SelfTest.h"
+#include "universalAlarmInput/adcDts.h"
+
+LOG_MODULE_REGISTER(pam8053SelfTest, LOG_LEVEL_INF);
+
+int Pmi8002SelfTestInit()
+{
+	return 0;
+}
+
+//Must run after AdcDtsInit, the ADC is calibrated before the sampling is started
+int Pmi8002SelfTestStart()
+{
+	int err;
+
+	LOG_INF("Self test started");
+
+	err = AdcDtsCalibrateInternal();
+	if (err < 0)
+	{
+		LOG_ERR("Self test: ADC calibration failed (Error: %d)", err);
+		return err;
+	}
+
+	LOG_INF("Self test done");
+	return 0;
+}
@@ -3,6 +3,8 @@
 #include <inttypes.h>
 #include <stddef.h>
 #include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include <zephyr/device.h>
 #include <zephyr/devicetree.h>
@@ -10,6 +12,10 @@
 #include <zephyr/kernel.h>
 #include <zephyr/logging/log.h>
 #include <zephyr/drivers/gpio.h>
+#include <zephyr/settings/settings.h>
+#if defined(CONFIG_SHELL)
+#include <zephyr/shell/shell.h>
+#endif
 
 LOG_MODULE_REGISTER(adcDts, CONFIG_LOG_DEFAULT_LEVEL);
 
@@ -19,15 +25,14 @@ LOG_MODULE_REGISTER(adcDts, CONFIG_LOG_DEFAULT_LEVEL);
 
 #define DT_SPEC_AND_COMMA(node_id, prop, idx) ADC_DT_SPEC_GET_BY_IDX(node_id, idx),
 
-#define A1_CTRL_1 DT_ALIAS(a1ctrl1)
-#define A1_CTRL_2 DT_ALIAS(a1ctrl2)
-#define A2_CTRL_1 DT_ALIAS(a2ctrl1)
-#define A2_CTRL_2 DT_ALIAS(a2ctrl2)
-
-static const struct gpio_dt_spec a1ctrl1_pin = GPIO_DT_SPEC_GET(A1_CTRL_1, gpios);
-static const struct gpio_dt_spec a1ctrl2_pin = GPIO_DT_SPEC_GET(A1_CTRL_2, gpios);
-static const struct gpio_dt_spec a2ctrl1_pin = GPIO_DT_SPEC_GET(A2_CTRL_1, gpios);
-static const struct gpio_dt_spec a2ctrl2_pin = GPIO_DT_SPEC_GET(A2_CTRL_2, gpios);
+//Mode control pins, indexed by the input number
+#if DT_NODE_HAS_PROP(ADC_DTS_USER_NODE, ctrl1_gpios)
+static const struct gpio_dt_spec ctrl1Pins[] = {DT_FOREACH_PROP_ELEM_SEP(ADC_DTS_USER_NODE, ctrl1_gpios, GPIO_DT_SPEC_GET_BY_IDX, (,))};
+static const struct gpio_dt_spec ctrl2Pins[] = {DT_FOREACH_PROP_ELEM_SEP(ADC_DTS_USER_NODE, ctrl2_gpios, GPIO_DT_SPEC_GET_BY_IDX, (,))};
+#else
+static const struct gpio_dt_spec ctrl1Pins[] = {GPIO_DT_SPEC_GET(DT_ALIAS(a1ctrl1), gpios), GPIO_DT_SPEC_GET(DT_ALIAS(a2ctrl1), gpios)};
+static const struct gpio_dt_spec ctrl2Pins[] = {GPIO_DT_SPEC_GET(DT_ALIAS(a1ctrl2), gpios), GPIO_DT_SPEC_GET(DT_ALIAS(a2ctrl2), gpios)};
+#endif
 
 static const struct adc_dt_spec adcChannels[] = {DT_FOREACH_PROP_ELEM(DT_PATH(zephyr_user), io_channels, DT_SPEC_AND_COMMA)};
 
@@ -41,12 +46,51 @@ K_TIMER_DEFINE(adcSampleTimer,adcSampleTimerCb,NULL);
 extern void adcWorkHandlerCb(struct k_work *work);
 K_WORK_DEFINE(adcWorkHandler,adcWorkHandlerCb);
 
+BUILD_ASSERT(ARRAY_SIZE(adcChannels) == ADC_DTS_CHANNEL_COUNT);
+BUILD_ASSERT(ARRAY_SIZE(ctrl1Pins) == ADC_DTS_INPUT_COUNT && ARRAY_SIZE(ctrl2Pins) == ADC_DTS_INPUT_COUNT,
+	"ctrl1-gpios and ctrl2-gpios must have a pin for each input");
+BUILD_ASSERT(ADC_DTS_REFERENCE_CHANNEL >= ADC_DTS_INPUT_COUNT && ADC_DTS_REFERENCE_CHANNEL < ADC_DTS_CHANNEL_COUNT,
+	"Each input needs an ADC channel, and the reference channel can't be one of them");
+
 int16_t adcOutputValues[ARRAY_SIZE(adcChannels)];
 bool valuesInitialized;
 
+static AdcDtsChannelConfig channelConfig[ARRAY_SIZE(adcChannels)];
+static int64_t lastEventTime[ARRAY_SIZE(adcChannels)];
+static bool channelInitPending[ARRAY_SIZE(adcChannels)]; //The next sample is sent as an init value, see AdcDtsRequestInitValue
+static AdcFilter channelFilter[ARRAY_SIZE(adcChannels)];
+static uint8_t channelOversampling[ARRAY_SIZE(adcChannels)]; //Configured or devicetree value in use
+static AdcDtsCalibration channelCalibration[ARRAY_SIZE(adcChannels)];
+
+//Sample history and captures, the ring buffers are written by the sampling path and only copied under the lock
+BUILD_ASSERT(ADC_DTS_CAPTURE_POST_SAMPLES > 0 && ADC_DTS_CAPTURE_PRE_SAMPLES > 0);
+BUILD_ASSERT(ADC_DTS_CAPTURE_PRE_SAMPLES + ADC_DTS_CAPTURE_POST_SAMPLES <= ADC_DTS_HISTORY_SIZE);
+static AdcDtsHistorySample history[ARRAY_SIZE(adcChannels)][ADC_DTS_HISTORY_SIZE];
+static uint16_t historyWrite[ARRAY_SIZE(adcChannels)];
+static uint16_t historyCount[ARRAY_SIZE(adcChannels)];
+static uint16_t capturePostRemaining[ARRAY_SIZE(adcChannels)];
+static int64_t captureTriggerTime[ARRAY_SIZE(adcChannels)];
+static AdcDtsCapture captures[ARRAY_SIZE(adcChannels)];
+static struct k_spinlock historyLock;
+
+static int adcSettingsSet(const char *name, size_t len, settings_read_cb read_cb, void *cb_arg);
+
+static struct settings_handler adcSettingsHandler = {
+	.name = ADC_DTS_SETTINGS_KEY,
+	.h_get = NULL,
+	.h_set = adcSettingsSet,
+	.h_commit = NULL,
+	.h_export = NULL
+};
+static struct k_spinlock channelConfigLock; //The configuration can be changed while the samples are processed
+
 //Prototype of the init ctrl signal gpio
 int initCtrlGpio();
 
+//Samples of the latest sampling cycle, in the devicetree order of the channels
+static int16_t sampleBuf[ARRAY_SIZE(adcChannels)];
+
+//One sequence per channel, used when the channels can't be sampled in one sequence
 int16_t buf;
 struct adc_sequence sequence = 
 {
@@ -54,74 +98,670 @@ struct adc_sequence sequence =
 	.buffer_size = sizeof(buf), //Buffer size in bytes, not number of samples
 };
 
-//Function that inits all the ADC channels defined in the devicetree overlay 
-int AdcDtsInit(analogInputEventHandler eventHandler)
+//Scan mode: all channels are sampled in one sequence, the driver writes the samples in ascending channel id order
+//The scan is repeated for oversampling, each repetition is written after the previous one
+#define SCAN_BUF_SAMPLES (ARRAY_SIZE(adcChannels) << ADC_DTS_MAX_SCAN_OVERSAMPLING)
+static bool scanEnabled;
+static uint8_t scanOversampling; //Largest oversampling of the channels, sets the number of repetitions
+static int16_t scanBuf[SCAN_BUF_SAMPLES];
+static uint8_t scanIndex[ARRAY_SIZE(adcChannels)]; //Position of each channel's sample in scanBuf
+static struct adc_sequence_options scanOptions =
+{
+	.interval_us = 0, //Repetitions back to back
+};
+static struct adc_sequence scanSequence = 
+{
+	.buffer = scanBuf,
+	.buffer_size = sizeof(scanBuf),
+};
+
+static AdcDtsStats stats;
+static uint64_t cycleTimeTotalUs;
+static int64_t firstCycleTime;
+
+//Adaptive sample rate
+static AdcDtsRateConfig rateConfig =
+{
+	.burstPeriodMs = ADC_DTS_BURST_PERIOD_MS,
+	.idlePeriodMs = ADC_DTS_ADAPTIVE_RATE ? ADC_DTS_IDLE_PERIOD_MS : ADC_DTS_BURST_PERIOD_MS,
+	.idleHoldMs = ADC_DTS_IDLE_HOLD_MS,
+};
+static atomic_t samplingOn;
+static bool burstMode;
+static int64_t lastActivityTime;
+static int16_t lastFilteredValues[ARRAY_SIZE(adcChannels)];
+
+//Timing of the sampling path, measured with the cycle counter from the sample timer expiry
+typedef struct
+{
+	AdcDtsLatencyStats stats;
+	uint64_t totalUs;
+} latencyRecorder;
+
+static latencyRecorder timerJitter;
+static latencyRecorder startLatency;
+static latencyRecorder dispatchLatency;
+static volatile uint32_t timerExpiryCycles; //Latest sample timer expiry
+static uint32_t timerPeriodCycles;
+static bool timerExpiryValid; //False until the first expiry after the timer was (re)started
+static uint32_t cycleExpiryCycles; //Timer expiry of the sampling cycle being processed
+
+#if defined(CONFIG_ADC_ASYNC)
+//Async mode: one buffer is filled by the acquisition thread while the other is processed
+static bool asyncEnabled;
+static int16_t asyncBufs[2][SCAN_BUF_SAMPLES];
+static uint32_t asyncConversionCycles[2]; //Time spent on the conversion of each buffer
+static uint32_t asyncExpiryCycles[2]; //Timer expiry that started the conversion of each buffer
+static atomic_t asyncBufBusy[2]; //Set from the start of the conversion until the buffer has been processed
+static struct adc_sequence asyncSequence;
+static struct k_poll_signal asyncSignal = K_POLL_SIGNAL_INITIALIZER(asyncSignal);
+static K_SEM_DEFINE(asyncTickSem, 0, 1);
+K_MSGQ_DEFINE(asyncFilledMsgq, sizeof(uint8_t), 2, 1);
+
+static void adcAcquisitionThreadFn(void);
+static void adcProcessingThreadFn(void);
+K_THREAD_DEFINE(adcAcquisitionThread, ADC_DTS_ACQUISITION_STACK_SIZE, adcAcquisitionThreadFn, NULL, NULL, NULL, ADC_DTS_ACQUISITION_PRIORITY, 0, 0);
+K_THREAD_DEFINE(adcProcessingThread, ADC_DTS_PROCESSING_STACK_SIZE, adcProcessingThreadFn, NULL, NULL, NULL, ADC_DTS_PROCESSING_PRIORITY, 0, 0);
+#endif
+
+static void latencyAdd(latencyRecorder *pRecorder, uint32_t cycles)
+{
+	AdcDtsLatencyStats *pStats = &pRecorder->stats;
+	uint32_t us = k_cyc_to_us_floor32(cycles);
+	uint32_t limit = ADC_DTS_HISTOGRAM_FIRST_US;
+	int bucket = 0;
+
+	while (bucket < ADC_DTS_HISTOGRAM_BUCKETS - 1 && us >= limit)
+	{
+		bucket++;
+		limit <<= 1;
+	}
+	pStats->histogram[bucket]++;
+
+	pStats->minUs = pStats->count == 0 ? us : MIN(pStats->minUs, us);
+	pStats->maxUs = MAX(pStats->maxUs, us);
+	pStats->count++;
+	pRecorder->totalUs += us;
+	pStats->meanUs = pRecorder->totalUs / pStats->count;
+}
+
+static void updateCycleStats(uint32_t cycles)
+{
+	uint32_t cycleTimeUs = k_cyc_to_us_floor32(cycles);
+
+	if (stats.cycles == 0)
+	{
+		firstCycleTime = k_uptime_get();
+	}
+	if (burstMode)
+	{
+		stats.burstCycles++;
+	}
+	stats.cycles++;
+	stats.cycleTimeLastUs = cycleTimeUs;
+	cycleTimeTotalUs += cycleTimeUs;
+	stats.cycleTimeAvgUs = cycleTimeTotalUs / stats.cycles;
+	stats.cycleTimeMaxUs = MAX(stats.cycleTimeMaxUs, cycleTimeUs);
+}
+
+//Set up the scan sequence, all channels must be on the same ADC and use the same resolution
+//Gain and reference are part of the channel setup, so they are kept per channel. The hardware oversampling of the
+//SAADC only works with a single channel, so oversampling is done by repeating the scan and averaging in software
+static int initScanSequence(void)
 {
 	int err;
-	inputEventHandler = eventHandler;
 
-	for(int i = 0; i < ARRAY_SIZE(adcChannels);i++)
+	err = adc_sequence_init_dt(&adcChannels[0], &scanSequence);
+	if (err < 0) 
 	{
-		if (!adc_is_ready_dt(&adcChannels[i])) 
+		return err;
+	}
+
+	scanOversampling = 0;
+	for (int i = 0; i < ARRAY_SIZE(adcChannels); i++)
+	{
+		if (channelOversampling[i] > ADC_DTS_MAX_SCAN_OVERSAMPLING)
 		{
-			LOG_ERR("ADC controller device %s not ready", adcChannels[i].dev->name);
-			return -1;
+			LOG_WRN("Oversampling of channel %d limited to %d in scan mode", i, ADC_DTS_MAX_SCAN_OVERSAMPLING);
+			channelOversampling[i] = ADC_DTS_MAX_SCAN_OVERSAMPLING;
 		}
+		scanOversampling = MAX(scanOversampling, channelOversampling[i]);
+	}
 
-		err = adc_channel_setup_dt(&adcChannels[i]);
-		if (err < 0) 
+	scanSequence.oversampling = 0;
+	scanSequence.buffer = scanBuf;
+	scanSequence.buffer_size = (ARRAY_SIZE(adcChannels) << scanOversampling) * sizeof(scanBuf[0]);
+	scanOptions.extra_samplings = BIT(scanOversampling) - 1;
+	scanSequence.options = scanOversampling > 0 ? &scanOptions : NULL;
+
+	for (int i = 1; i < ARRAY_SIZE(adcChannels); i++)
+	{
+		if (adcChannels[i].dev != adcChannels[0].dev || adcChannels[i].resolution != adcChannels[0].resolution ||
+			(scanSequence.channels & BIT(adcChannels[i].channel_id)))
 		{
-			LOG_ERR("Could not setup channel #%d (Error: %d)", i, err);
-			return -1;
+			return -ENOTSUP;
 		}
-		LOG_INF("ADC Channels initialized:%d",adcChannels[i].channel_id);
+		scanSequence.channels |= BIT(adcChannels[i].channel_id);
 	}
 
-	initCtrlGpio();
+	for (int i = 0; i < ARRAY_SIZE(adcChannels); i++)
+	{
+		scanIndex[i] = 0;
+		for (int j = 0; j < ARRAY_SIZE(adcChannels); j++)
+		{
+			if (adcChannels[j].channel_id < adcChannels[i].channel_id)
+			{
+				scanIndex[i]++;
+			}
+		}
+	}
 	return 0;
 }
 
-void adcWorkHandlerCb(struct k_work *work)
+//Average of the channel's samples in the repetitions of a scan, a channel uses the first 2^oversampling repetitions
+static int16_t scanSample(const int16_t *pBuf, uint8_t channel)
+{
+	int32_t sum = 0;
+	uint8_t oversampling = channelOversampling[channel];
+
+	for (int i = 0; i < BIT(oversampling); i++)
+	{
+		sum += pBuf[i * ARRAY_SIZE(adcChannels) + scanIndex[channel]];
+	}
+	return (int16_t)((sum + (BIT(oversampling) >> 1)) >> oversampling);
+}
+
+//Read all channels into sampleBuf. Returns a bit mask of the channels that were read
+static uint32_t acquireSamples(void)
 {
 	int err;
+	uint32_t readMask = 0;
 
-	//Read the ADC value from all channels initialized
-	for(int i = 0; i< ARRAY_SIZE(adcChannels);i++)
+	if (scanEnabled)
+	{
+		err = adc_read(adcChannels[0].dev, &scanSequence);
+		if (err < 0) 
+		{
+			LOG_ERR("Could not read channels (Error: %d)", err);
+			return 0;
+		}
+
+		for (int i = 0; i < ARRAY_SIZE(adcChannels); i++)
+		{
+			sampleBuf[i] = scanSample(scanBuf, i);
+		}
+		return BIT_MASK(ARRAY_SIZE(adcChannels));
+	}
+
+	for (int i = 0; i < ARRAY_SIZE(adcChannels); i++)
 	{
 		err = adc_sequence_init_dt(&adcChannels[i], &sequence);
 		if (err < 0) 
 		{
 			LOG_ERR("Could not init sequence on channel:%d",i);
+			continue;
 		}
+		//Averaged by the ADC
+		sequence.oversampling = channelOversampling[i];
 
 		err = adc_read(adcChannels[i].dev, &sequence);
 		if (err < 0) 
 		{
 			LOG_ERR("Could not read channel#%d (Error: %d)", i, err);
+			continue;
+		}
+		sampleBuf[i] = buf;
+		readMask |= BIT(i);
+	}
+	return readMask;
+}
+
+static int16_t applyCalibration(uint8_t channel, int16_t value)
+{
+	int64_t corrected = ((int64_t)(value - channelCalibration[channel].offset) * channelCalibration[channel].gainPpm) / ADC_DTS_GAIN_PPM_UNITY;
+
+	return (int16_t)CLAMP(corrected, INT16_MIN, INT16_MAX);
+}
+
+static bool calibrationValid(const AdcDtsCalibration *pCalibration)
+{
+	return abs(pCalibration->offset) <= ADC_DTS_OFFSET_MAX &&
+		pCalibration->gainPpm >= ADC_DTS_GAIN_PPM_MIN && pCalibration->gainPpm <= ADC_DTS_GAIN_PPM_MAX;
+}
+
+static int adcSettingsSet(const char *name, size_t len, settings_read_cb read_cb, void *cb_arg)
+{
+	const char *next;
+	AdcDtsCalibration calibration[ARRAY_SIZE(adcChannels)];
+	int rc;
+
+	if (!settings_name_steq(name, ADC_DTS_SETTINGS_CALIBRATION_KEY, &next) || next)
+	{
+		return -ENOENT;
+	}
+
+	//Stored with a different number of channels
+	if (len != sizeof(calibration))
+	{
+		LOG_WRN("Stored ADC calibration doesn't match the channels, not used");
+		return -EINVAL;
+	}
+
+	rc = read_cb(cb_arg, calibration, sizeof(calibration));
+	if (rc < 0)
+	{
+		return rc;
+	}
+
+	for (int i = 0; i < ARRAY_SIZE(adcChannels); i++)
+	{
+		if (calibrationValid(&calibration[i]))
+		{
+			channelCalibration[i] = calibration[i];
+			LOG_INF("ADC channel %d calibration: offset %d, gain %d ppm", i, calibration[i].offset, calibration[i].gainPpm);
+		}
+		else
+		{
+			LOG_WRN("Invalid stored calibration on ADC channel %d", i);
+		}
+	}
+	return 0;
+}
+
+//Average of raw samples of a channel, read outside the sampling cycle. The ADC driver serializes the reads
+static int readRawAverage(uint8_t channel, uint16_t count, bool calibrate, int32_t *pAverage)
+{
+	int16_t sample;
+	int32_t sum = 0;
+	int err;
+	struct adc_sequence calibrationSequence = {0};
+
+	err = adc_sequence_init_dt(&adcChannels[channel], &calibrationSequence);
+	if (err < 0)
+	{
+		return err;
+	}
+	calibrationSequence.buffer = &sample;
+	calibrationSequence.buffer_size = sizeof(sample);
+
+	for (int i = 0; i < count; i++)
+	{
+		calibrationSequence.calibrate = calibrate && i == 0;
+		err = adc_read(adcChannels[channel].dev, &calibrationSequence);
+		if (err < 0)
+		{
+			LOG_ERR("Could not read channel#%d (Error: %d)", channel, err);
+			return err;
+		}
+		sum += sample;
+	}
+
+	*pAverage = (sum + (sum >= 0 ? count / 2 : -(count / 2))) / count;
+	return 0;
+}
+
+//Freeze the window of a capture when its last post trigger sample has been written
+static void captureComplete(uint8_t channel)
+{
+	AdcDtsCapture *pCapture = &captures[channel];
+	uint16_t count = MIN(historyCount[channel], ARRAY_SIZE(pCapture->samples));
+	uint16_t read = (historyWrite[channel] + ADC_DTS_HISTORY_SIZE - count) % ADC_DTS_HISTORY_SIZE;
+
+	for (int i = 0; i < count; i++)
+	{
+		pCapture->samples[i] = history[channel][read];
+		read = (read + 1) % ADC_DTS_HISTORY_SIZE;
+	}
+	pCapture->count = count;
+	pCapture->triggerIndex = count - ADC_DTS_CAPTURE_POST_SAMPLES - 1;
+	pCapture->triggerTime = captureTriggerTime[channel];
+	pCapture->sequence++;
+}
+
+//Add a raw sample to the history of the channel
+static void historyAdd(uint8_t channel, int16_t value, int64_t now)
+{
+	k_spinlock_key_t key = k_spin_lock(&historyLock);
+
+	history[channel][historyWrite[channel]].timeMs = (uint16_t)now;
+	history[channel][historyWrite[channel]].value = value;
+	historyWrite[channel] = (historyWrite[channel] + 1) % ADC_DTS_HISTORY_SIZE;
+	if (historyCount[channel] < ADC_DTS_HISTORY_SIZE)
+	{
+		historyCount[channel]++;
+	}
+
+	if (capturePostRemaining[channel] > 0)
+	{
+		capturePostRemaining[channel]--;
+		if (capturePostRemaining[channel] == 0)
+		{
+			captureComplete(channel);
 		}
+	}
+	k_spin_unlock(&historyLock, key);
+}
+
+//Returns true if the value has moved outside the deadband around the last reported value
+static bool outsideDeadband(uint8_t channel, int16_t value)
+{
+	const AdcDtsChannelConfig *pConfig = &channelConfig[channel];
+	uint32_t change = abs(value - adcOutputValues[channel]);
+	uint32_t relativeDeadband = ((uint32_t)abs(adcOutputValues[channel]) * pConfig->deadbandRelPermille) / 1000;
+
+	return change > MAX(pConfig->deadbandAbs, relativeDeadband);
+}
+
+//Restart the sample timer at the burst or idle period
+static void startSampleTimer(bool burst)
+{
+	k_timeout_t period = K_MSEC(burst ? rateConfig.burstPeriodMs : rateConfig.idlePeriodMs);
+
+	burstMode = burst;
+	stats.burstMode = burst;
+	if (atomic_get(&samplingOn))
+	{
+		timerPeriodCycles = k_ms_to_cyc_floor32(burst ? rateConfig.burstPeriodMs : rateConfig.idlePeriodMs);
+		timerExpiryValid = false;
+		k_timer_start(&adcSampleTimer, period, period);
+	}
+}
+
+//Called after each sampling cycle, activity switches to the burst period and the idle period is resumed when the
+//channels have been stable for the hold time
+static void updateSampleRate(bool activity)
+{
+	int64_t now = k_uptime_get();
 
-		// TODO: Investigate why we get negative values in the range -10 to 0
-		if (buf < 0)
+	if (activity)
+	{
+		lastActivityTime = now;
+		if (!burstMode)
 		{
-			buf = 0;
+			LOG_DBG("ADC burst sampling");
+			startSampleTimer(true);
 		}
-		
-		// TODO: Consider threashodd
-		if (adcOutputValues[i] != buf || valuesInitialized == false)
+	}
+	else if (burstMode && rateConfig.idlePeriodMs != rateConfig.burstPeriodMs && now - lastActivityTime >= rateConfig.idleHoldMs)
+	{
+		LOG_DBG("ADC idle sampling");
+		startSampleTimer(false);
+	}
+}
+
+//Handle a new sample of a channel, the event handler is called if the value has changed
+//Returns true if the channel is active: an event was raised or the value is still moving
+static bool processSample(uint8_t channel, int16_t value)
+{
+	int64_t now;
+	bool init;
+	bool report;
+	bool moving;
+	k_spinlock_key_t key;
+
+	stats.samples[channel]++;
+
+	//Written before the event is raised, so a capture triggered by the event includes this sample
+	now = k_uptime_get();
+	historyAdd(channel, value, now);
+
+	key = k_spin_lock(&channelConfigLock);
+	value = applyCalibration(channel, value);
+
+	//The ADC offset gives small negative values around 0 V, the noise left after the offset correction is clamped
+	if (value < 0)
+	{
+		value = 0;
+	}
+
+	value = AdcFilterUpdate(&channelFilter[channel], value);
+
+	//Noise within the deadband isn't reported, a change is held back until the minimum event interval has passed
+	init = !valuesInitialized || channelInitPending[channel];
+	channelInitPending[channel] = false;
+	report = init ||
+		(outsideDeadband(channel, value) && now - lastEventTime[channel] >= channelConfig[channel].minEventIntervalMs);
+	//Half the deadband between two samples is a transition, even when it isn't reported yet
+	moving = valuesInitialized && abs(value - lastFilteredValues[channel]) > MAX(channelConfig[channel].deadbandAbs / 2, 1);
+	k_spin_unlock(&channelConfigLock, key);
+	lastFilteredValues[channel] = value;
+
+	if (!report)
+	{
+		return moving;
+	}
+
+	lastEventTime[channel] = now;
+	stats.events[channel]++;
+	adcOutputValues[channel] = value;
+	if (inputEventHandler !=  NULL)
+	{
+		AnalogInputEvent ev;
+
+		ev.event = init ? ANALOG_INPUT_INIT_VALUE : ANALOG_INPUT_CHANGED;
+		ev.inputNo = channel; // TOOD: Consider??? adcChannels[i].channel_id;
+		ev.value = adcOutputValues[channel];
+		latencyAdd(&dispatchLatency, k_cycle_get_32() - cycleExpiryCycles);
+		(*inputEventHandler)(&ev);
+	}
+	return true;
+}
+
+#if defined(CONFIG_ADC_ASYNC)
+//Started by the sample timer, runs the conversion into a free buffer and hands it to the processing thread
+static void adcAcquisitionThreadFn(void)
+{
+	struct k_poll_event asyncEvent = K_POLL_EVENT_INITIALIZER(K_POLL_TYPE_SIGNAL, K_POLL_MODE_NOTIFY_ONLY, &asyncSignal);
+	uint8_t fill = 0;
+	uint32_t start;
+	unsigned int signaled;
+	int result;
+	int err;
+
+	while (1)
+	{
+		k_sem_take(&asyncTickSem, K_FOREVER);
+		latencyAdd(&startLatency, k_cycle_get_32() - timerExpiryCycles);
+
+		if (!atomic_cas(&asyncBufBusy[fill], 0, 1))
 		{
-			adcOutputValues[i] = (int)buf;
-			if (inputEventHandler !=  NULL)
+			//The processing thread is behind, both buffers are waiting
+			stats.overruns++;
+			continue;
+		}
+
+		start = k_cycle_get_32();
+		asyncExpiryCycles[fill] = timerExpiryCycles;
+		asyncSequence.buffer = asyncBufs[fill];
+
+		err = adc_read_async(adcChannels[0].dev, &asyncSequence, &asyncSignal);
+		if (err == 0)
+		{
+			err = k_poll(&asyncEvent, 1, K_MSEC(ADC_SAMPLE_TIME_MS));
+			if (err == -EAGAIN)
+			{
+				//The conversion is still writing to the buffer, so neither the buffer nor the signal can be
+				//reused before it has completed. The late samples are dropped
+				LOG_WRN("ADC conversion timed out, waiting for it to complete");
+				(void)k_poll(&asyncEvent, 1, K_FOREVER);
+				err = -ETIMEDOUT;
+			}
+			k_poll_signal_check(&asyncSignal, &signaled, &result);
+			if (err == 0 && (!signaled || result < 0))
 			{
-				AnalogInputEvent ev;
+				err = signaled ? result : -EIO;
+			}
+		}
+		k_poll_signal_reset(&asyncSignal);
+		asyncEvent.state = K_POLL_STATE_NOT_READY;
+
+		if (err < 0)
+		{
+			LOG_ERR("Could not read channels (Error: %d)", err);
+			atomic_clear(&asyncBufBusy[fill]);
+			continue;
+		}
+
+		asyncConversionCycles[fill] = k_cycle_get_32() - start;
+		(void)k_msgq_put(&asyncFilledMsgq, &fill, K_NO_WAIT);
+		fill ^= 1;
+	}
+}
+
+//Processes the filled buffers at low priority, the buffer is released for the next conversion when done
+static void adcProcessingThreadFn(void)
+{
+	uint8_t index;
+	uint32_t start;
+	bool activity;
+
+	while (1)
+	{
+		k_msgq_get(&asyncFilledMsgq, &index, K_FOREVER);
+		start = k_cycle_get_32();
+		cycleExpiryCycles = asyncExpiryCycles[index];
+
+		activity = false;
+		for (int i = 0; i < ARRAY_SIZE(adcChannels); i++)
+		{
+			activity |= processSample(i, scanSample(asyncBufs[index], i));
+		}
+		valuesInitialized = true;
+
+		updateCycleStats(asyncConversionCycles[index] + (k_cycle_get_32() - start));
+		atomic_clear(&asyncBufBusy[index]);
+		updateSampleRate(activity);
+	}
+}
+#endif
+
+//Function that inits all the ADC channels defined in the devicetree overlay 
+int AdcDtsInit(analogInputEventHandler eventHandler, const AdcDtsChannelConfig *pConfig)
+{
+	int err;
+	inputEventHandler = eventHandler;
+
+	for (int i = 0; i < ARRAY_SIZE(adcChannels); i++)
+	{
+		channelCalibration[i].offset = 0;
+		channelCalibration[i].gainPpm = ADC_DTS_GAIN_PPM_UNITY;
+	}
+
+	//The channels are used without correction if the calibration can't be loaded
+	err = settings_subsys_init();
+	if (err == 0)
+	{
+		err = settings_register(&adcSettingsHandler);
+	}
+	if (err == 0)
+	{
+		err = settings_load_subtree(ADC_DTS_SETTINGS_KEY);
+	}
+	if (err < 0)
+	{
+		LOG_ERR("Could not load the ADC calibration (Error: %d)", err);
+	}
+
+	for (int i = 0; i < ARRAY_SIZE(adcChannels); i++)
+	{
+		if (pConfig != NULL)
+		{
+			channelConfig[i] = pConfig[i];
+		}
+		else
+		{
+			channelConfig[i].deadbandAbs = ADC_DTS_DEFAULT_DEADBAND_ABS;
+			channelConfig[i].deadbandRelPermille = ADC_DTS_DEFAULT_DEADBAND_REL_PERMILLE;
+			channelConfig[i].minEventIntervalMs = ADC_DTS_DEFAULT_MIN_EVENT_INTERVAL_MS;
+			channelConfig[i].filterType = ADC_DTS_DEFAULT_FILTER_TYPE;
+			channelConfig[i].filterLength = ADC_DTS_DEFAULT_FILTER_LENGTH;
+			channelConfig[i].oversampling = ADC_DTS_DEFAULT_OVERSAMPLING;
+		}
+
+		channelOversampling[i] = channelConfig[i].oversampling != 0 ? channelConfig[i].oversampling : adcChannels[i].oversampling;
+		if (channelOversampling[i] > ADC_DTS_MAX_OVERSAMPLING)
+		{
+			LOG_ERR("Invalid oversampling on channel %d", i);
+			channelOversampling[i] = 0;
+		}
+
+		err = AdcFilterInit(&channelFilter[i], channelConfig[i].filterType, channelConfig[i].filterLength);
+		if (err < 0)
+		{
+			LOG_ERR("Invalid filter on channel %d, the samples are not filtered", i);
+			channelConfig[i].filterType = ADC_FILTER_NONE;
+		}
+	}
+
+	for(int i = 0; i < ARRAY_SIZE(adcChannels);i++)
+	{
+		if (!adc_is_ready_dt(&adcChannels[i])) 
+		{
+			LOG_ERR("ADC controller device %s not ready", adcChannels[i].dev->name);
+			return -1;
+		}
+
+		err = adc_channel_setup_dt(&adcChannels[i]);
+		if (err < 0) 
+		{
+			LOG_ERR("Could not setup channel #%d (Error: %d)", i, err);
+			return -1;
+		}
+		LOG_INF("ADC Channels initialized:%d",adcChannels[i].channel_id);
+	}
+
+	scanEnabled = false;
+	if (ADC_DTS_SCAN_MODE)
+	{
+		err = initScanSequence();
+		if (err == 0)
+		{
+			scanEnabled = true;
+		}
+		else
+		{
+			LOG_WRN("Channels can't be sampled in one sequence (Error: %d), reading them one by one", err);
+		}
+	}
+	stats.scanMode = scanEnabled;
+
+#if defined(CONFIG_ADC_ASYNC)
+	//The async mode is built on the scan sequence, a single conversion covers all channels
+	asyncEnabled = ADC_DTS_ASYNC_MODE && scanEnabled;
+	if (asyncEnabled)
+	{
+		asyncSequence = scanSequence;
+	}
+	stats.asyncMode = asyncEnabled;
+#endif
+
+	initCtrlGpio();
+	return 0;
+}
+
+void adcWorkHandlerCb(struct k_work *work)
+{
+	uint32_t start = k_cycle_get_32();
+	uint32_t readMask;
+	bool activity = false;
 
-				ev.event = valuesInitialized ? ANALOG_INPUT_CHANGED : ANALOG_INPUT_INIT_VALUE;
-				ev.inputNo = i; // TOOD: Consider??? adcChannels[i].channel_id;
-				ev.value = adcOutputValues[i];
-				(*inputEventHandler)(&ev);
-			}		
+	cycleExpiryCycles = timerExpiryCycles;
+	latencyAdd(&startLatency, start - cycleExpiryCycles);
+
+	//Read the ADC value from all channels initialized
+	readMask = acquireSamples();
+
+	for(int i = 0; i< ARRAY_SIZE(adcChannels);i++)
+	{
+		if (readMask & BIT(i))
+		{
+			activity |= processSample(i, sampleBuf[i]);
 		}
 	}	
 	valuesInitialized = true;
+
+	updateCycleStats(k_cycle_get_32() - start);
+	updateSampleRate(activity);
 }
 
 //Function that runs through the output buffer and gets the latest value for a given channel
@@ -149,139 +789,446 @@ int AdcDtsGetSample(uint8_t channelNumber)
 */
 }
 
-void adcSampleTimerCb(struct k_timer *timer_id)
+int AdcDtsGetMillivolts(uint8_t channelNumber, int32_t *pMillivolts)
 {
-	k_work_submit(&adcWorkHandler);
+	int32_t value;
+	int err;
+
+	if (channelNumber >= ARRAY_SIZE(adcChannels) || pMillivolts == NULL)
+	{
+		LOG_ERR("Invalid channel number");
+		return -EINVAL;
+	}
+
+	value = adcOutputValues[channelNumber];
+	err = adc_raw_to_millivolts_dt(&adcChannels[channelNumber], &value);
+	if (err < 0)
+	{
+		LOG_ERR("Channel %d can't be converted to millivolts (Error: %d)", channelNumber, err);
+		return err;
+	}
+	*pMillivolts = value;
+	return 0;
 }
 
+int AdcDtsCalibrateInternal(void)
+{
+	int32_t average;
+	int err;
+
+	err = readRawAverage(0, 1, true, &average);
+	if (err < 0)
+	{
+		LOG_ERR("ADC calibration failed (Error: %d)", err);
+		return err;
+	}
+	LOG_INF("ADC calibrated");
+	return 0;
+}
 
-void AdcDtsTurnOff()
+int AdcDtsCalibrateOffset(uint8_t channelNumber)
 {
-	k_timer_stop(&adcSampleTimer);
-	LOG_INF("ADC turned off (sample timer stopped)");
+	int32_t average;
+	int err;
+	k_spinlock_key_t key;
+
+	if (channelNumber >= ARRAY_SIZE(adcChannels))
+	{
+		LOG_ERR("Invalid channel number");
+		return -EINVAL;
+	}
+
+	err = readRawAverage(channelNumber, ADC_DTS_CALIBRATION_SAMPLES, true, &average);
+	if (err < 0)
+	{
+		return err;
+	}
+
+	if (abs(average) > ADC_DTS_OFFSET_MAX)
+	{
+		LOG_ERR("Offset %d on channel %d is out of range, is the input at 0 V?", average, channelNumber);
+		return -ERANGE;
+	}
+
+	key = k_spin_lock(&channelConfigLock);
+	channelCalibration[channelNumber].offset = (int16_t)average;
+	k_spin_unlock(&channelConfigLock, key);
+
+	LOG_INF("ADC channel %d offset: %d", channelNumber, average);
+	return 0;
 }
 
-//This function is only for when the adcInit has been called, and then the adcTurnOff was called
-void AdcDtsTurnOn()
+int AdcDtsCalibrateGain(uint8_t channelNumber, int32_t referenceMv)
 {
-	LOG_INF("ADC turned on (sample timer starting)");
-	k_timer_start(&adcSampleTimer, K_MSEC(ADC_SAMPLE_TIME_MS), K_MSEC(ADC_SAMPLE_TIME_MS));	
+	int32_t measuredMv;
+	uint32_t gainPpm;
+	int err;
+	k_spinlock_key_t key;
+
+	if (channelNumber >= ARRAY_SIZE(adcChannels) || referenceMv <= 0)
+	{
+		LOG_ERR("Invalid channel number or reference");
+		return -EINVAL;
+	}
+
+	err = readRawAverage(channelNumber, ADC_DTS_CALIBRATION_SAMPLES, false, &measuredMv);
+	if (err < 0)
+	{
+		return err;
+	}
+
+	measuredMv -= channelCalibration[channelNumber].offset;
+	err = adc_raw_to_millivolts_dt(&adcChannels[channelNumber], &measuredMv);
+	if (err < 0)
+	{
+		LOG_ERR("Channel %d can't be converted to millivolts (Error: %d)", channelNumber, err);
+		return err;
+	}
+
+	gainPpm = measuredMv > 0 ? ((uint64_t)referenceMv * ADC_DTS_GAIN_PPM_UNITY) / measuredMv : 0;
+	if (gainPpm < ADC_DTS_GAIN_PPM_MIN || gainPpm > ADC_DTS_GAIN_PPM_MAX)
+	{
+		LOG_ERR("Measured %d mV on channel %d, expected %d mV", measuredMv, channelNumber, referenceMv);
+		return -ERANGE;
+	}
+
+	key = k_spin_lock(&channelConfigLock);
+	channelCalibration[channelNumber].gainPpm = gainPpm;
+	k_spin_unlock(&channelConfigLock, key);
+
+	LOG_INF("ADC channel %d gain: %d ppm", channelNumber, gainPpm);
+	return 0;
 }
 
-int initCtrlGpio()
+int AdcDtsGetCalibration(uint8_t channelNumber, AdcDtsCalibration *pCalibration)
+{
+	if (channelNumber >= ARRAY_SIZE(adcChannels) || pCalibration == NULL)
+	{
+		LOG_ERR("Invalid channel number");
+		return -EINVAL;
+	}
+	*pCalibration = channelCalibration[channelNumber];
+	return 0;
+}
+
+int AdcDtsCaptureTrigger(uint8_t channelNumber)
+{
+	k_spinlock_key_t key;
+	int err = 0;
+
+	if (channelNumber >= ARRAY_SIZE(adcChannels))
+	{
+		LOG_ERR("Invalid channel number");
+		return -EINVAL;
+	}
+
+	key = k_spin_lock(&historyLock);
+	if (capturePostRemaining[channelNumber] > 0)
+	{
+		err = -EBUSY;
+	}
+	else if (historyCount[channelNumber] == 0)
+	{
+		err = -ENODATA;
+	}
+	else
+	{
+		capturePostRemaining[channelNumber] = ADC_DTS_CAPTURE_POST_SAMPLES;
+		captureTriggerTime[channelNumber] = k_uptime_get();
+	}
+	k_spin_unlock(&historyLock, key);
+	return err;
+}
+
+int AdcDtsGetCapture(uint8_t channelNumber, AdcDtsCapture *pCapture)
+{
+	k_spinlock_key_t key;
+	int err = 0;
+
+	if (channelNumber >= ARRAY_SIZE(adcChannels) || pCapture == NULL)
+	{
+		LOG_ERR("Invalid channel number");
+		return -EINVAL;
+	}
+
+	key = k_spin_lock(&historyLock);
+	if (captures[channelNumber].sequence == 0)
+	{
+		err = -ENODATA;
+	}
+	else
+	{
+		*pCapture = captures[channelNumber];
+	}
+	k_spin_unlock(&historyLock, key);
+	return err;
+}
+
+int AdcDtsResetCalibration(uint8_t channelNumber)
+{
+	k_spinlock_key_t key;
+
+	if (channelNumber >= ARRAY_SIZE(adcChannels))
+	{
+		LOG_ERR("Invalid channel number");
+		return -EINVAL;
+	}
+
+	key = k_spin_lock(&channelConfigLock);
+	channelCalibration[channelNumber].offset = 0;
+	channelCalibration[channelNumber].gainPpm = ADC_DTS_GAIN_PPM_UNITY;
+	k_spin_unlock(&channelConfigLock, key);
+	return 0;
+}
+
+int AdcDtsSaveCalibration(void)
 {
 	int err;
 
-	if (!gpio_is_ready_dt(&a1ctrl1_pin)) 
+	err = settings_save_one(ADC_DTS_SETTINGS_KEY "/" ADC_DTS_SETTINGS_CALIBRATION_KEY, channelCalibration, sizeof(channelCalibration));
+	if (err)
 	{
-		LOG_ERR("Gpio not ready");
-		return -1;
+		LOG_ERR("ADC calibration settings_save_one failed (err %d)", err);
 	}
-	if (!gpio_is_ready_dt(&a1ctrl2_pin)) 
+	return err;
+}
+
+int AdcDtsSetChannelConfig(uint8_t channelNumber, const AdcDtsChannelConfig *pConfig)
+{
+	AdcFilter filter;
+	uint8_t oversampling;
+	k_spinlock_key_t key;
+
+	if (channelNumber >= ARRAY_SIZE(adcChannels) || pConfig == NULL)
 	{
-		LOG_ERR("Gpio not ready");
-		return -1;
+		LOG_ERR("Invalid channel number");
+		return -EINVAL;
 	}
-	
-	if (!gpio_is_ready_dt(&a2ctrl1_pin)) 
+
+	if (AdcFilterInit(&filter, pConfig->filterType, pConfig->filterLength) < 0)
 	{
-		LOG_ERR("Gpio not ready");
-		return -1;
+		LOG_ERR("Invalid filter type %d with length %d", pConfig->filterType, pConfig->filterLength);
+		return -EINVAL;
 	}
-	if (!gpio_is_ready_dt(&a2ctrl2_pin)) 
+
+	oversampling = pConfig->oversampling != 0 ? pConfig->oversampling : adcChannels[channelNumber].oversampling;
+	//The number of scan repetitions is set at init
+	if (oversampling > (scanEnabled ? scanOversampling : ADC_DTS_MAX_OVERSAMPLING))
 	{
-		LOG_ERR("Gpio not ready");
-		return -1;
+		LOG_ERR("Oversampling %d not supported on channel %d", oversampling, channelNumber);
+		return -ENOTSUP;
 	}
-	
-	err = gpio_pin_configure_dt(&a1ctrl1_pin, GPIO_OUTPUT_ACTIVE);
-	if (err < 0) 
+
+	key = k_spin_lock(&channelConfigLock);
+	//The running filter is kept when only the change detection is changed
+	if (pConfig->filterType != channelConfig[channelNumber].filterType ||
+		pConfig->filterLength != channelConfig[channelNumber].filterLength)
 	{
-		LOG_ERR("Config failed");
-		return -1;
+		channelFilter[channelNumber] = filter;
 	}
-	err = gpio_pin_configure_dt(&a1ctrl2_pin, GPIO_OUTPUT_ACTIVE);
-	if (err < 0) 
+	channelConfig[channelNumber] = *pConfig;
+	channelOversampling[channelNumber] = oversampling;
+	k_spin_unlock(&channelConfigLock, key);
+	return 0;
+}
+
+int AdcDtsRequestInitValue(uint8_t channelNumber)
+{
+	k_spinlock_key_t key;
+
+	if (channelNumber >= ARRAY_SIZE(adcChannels))
 	{
-		LOG_ERR("Config failed");
-		return -1;
+		LOG_ERR("Invalid channel number");
+		return -EINVAL;
 	}
-	
-	err = gpio_pin_configure_dt(&a2ctrl1_pin, GPIO_OUTPUT_ACTIVE);
-	if (err < 0) 
+
+	key = k_spin_lock(&channelConfigLock);
+	channelInitPending[channelNumber] = true;
+	k_spin_unlock(&channelConfigLock, key);
+	return 0;
+}
+
+void AdcDtsGetStats(AdcDtsStats *pStats)
+{
+	int64_t elapsed;
+
+	if (pStats != NULL)
 	{
-		LOG_ERR("Config failed");
-		return -1;
+		*pStats = stats;
+		pStats->timerJitter = timerJitter.stats;
+		pStats->startLatency = startLatency.stats;
+		pStats->dispatchLatency = dispatchLatency.stats;
+		elapsed = k_uptime_get() - firstCycleTime;
+		if (stats.cycles > 1 && elapsed > 0)
+		{
+			pStats->sampleRateAvgMilliHz = (uint32_t)(((uint64_t)(stats.cycles - 1) * 1000000) / elapsed);
+		}
 	}
-	err = gpio_pin_configure_dt(&a2ctrl2_pin, GPIO_OUTPUT_ACTIVE);
-	if (err < 0) 
+}
+
+void AdcDtsResetTimingStats(void)
+{
+	memset(&timerJitter, 0, sizeof(timerJitter));
+	memset(&startLatency, 0, sizeof(startLatency));
+	memset(&dispatchLatency, 0, sizeof(dispatchLatency));
+}
+
+#if defined(CONFIG_SHELL)
+static void shellPrintLatency(const struct shell *sh, const char *name, const AdcDtsLatencyStats *pStats)
+{
+	uint32_t limit = ADC_DTS_HISTOGRAM_FIRST_US;
+
+	shell_print(sh, "%s: %u samples, min %u us, mean %u us, max %u us", name, pStats->count, pStats->minUs, pStats->meanUs, pStats->maxUs);
+	for (int i = 0; i < ADC_DTS_HISTOGRAM_BUCKETS; i++)
 	{
-		LOG_ERR("Config failed");
-		return -1;
+		if (i < ADC_DTS_HISTOGRAM_BUCKETS - 1)
+		{
+			shell_print(sh, "  < %6u us: %u", limit, pStats->histogram[i]);
+		}
+		else
+		{
+			shell_print(sh, "  >= %5u us: %u", limit >> 1, pStats->histogram[i]);
+		}
+		limit <<= 1;
 	}
-	
+}
+
+static int cmdAdcTiming(const struct shell *sh, size_t argc, char **argv)
+{
+	AdcDtsStats adcStats;
+
+	AdcDtsGetStats(&adcStats);
+	shellPrintLatency(sh, "Timer jitter", &adcStats.timerJitter);
+	shellPrintLatency(sh, "Start latency", &adcStats.startLatency);
+	shellPrintLatency(sh, "Dispatch latency", &adcStats.dispatchLatency);
 	return 0;
 }
 
+static int cmdAdcTimingReset(const struct shell *sh, size_t argc, char **argv)
+{
+	AdcDtsResetTimingStats();
+	shell_print(sh, "ADC timing statistics cleared");
+	return 0;
+}
 
-int AdcDtsSetCtrl1(int inputChannel)
+SHELL_STATIC_SUBCMD_SET_CREATE(adcSubCmds,
+	SHELL_CMD(timing, NULL, "Show the sampling jitter and latency histograms", cmdAdcTiming),
+	SHELL_CMD(reset, NULL, "Clear the timing statistics", cmdAdcTimingReset),
+	SHELL_SUBCMD_SET_END
+);
+SHELL_CMD_REGISTER(adc, &adcSubCmds, "ADC sampling diagnostics", NULL);
+#endif
+
+int AdcDtsSetRateConfig(const AdcDtsRateConfig *pConfig)
 {
-	int err;
-	switch(inputChannel)
+	if (pConfig == NULL || pConfig->burstPeriodMs < ADC_DTS_MIN_PERIOD_MS || pConfig->idlePeriodMs > ADC_DTS_MAX_PERIOD_MS ||
+		pConfig->idlePeriodMs < pConfig->burstPeriodMs)
 	{
-		case 0:
-			err = gpio_pin_set_dt(&a1ctrl1_pin,true);
-			if (err != 0)  	
-			{
-				LOG_ERR("Pin set failed");
-				return -1;
-			}
-		break;
+		LOG_ERR("Invalid sample rate configuration");
+		return -EINVAL;
+	}
 
-		case 1:
-			err = gpio_pin_set_dt(&a2ctrl1_pin,true);
-			if (err != 0) 
-			{
-				LOG_ERR("Pin set failed");
-				return -1;
-			}
-		break;
+	rateConfig = *pConfig;
+	LOG_INF("ADC sampling period burst %d ms, idle %d ms", rateConfig.burstPeriodMs, rateConfig.idlePeriodMs);
+	//Sample at the burst period until the channels are stable again
+	lastActivityTime = k_uptime_get();
+	startSampleTimer(true);
+	return 0;
+}
+
+void adcSampleTimerCb(struct k_timer *timer_id)
+{
+	uint32_t now = k_cycle_get_32();
+	uint32_t interval = now - timerExpiryCycles;
+
+	if (timerExpiryValid)
+	{
+		latencyAdd(&timerJitter, interval > timerPeriodCycles ? interval - timerPeriodCycles : timerPeriodCycles - interval);
+	}
+	timerExpiryCycles = now;
+	timerExpiryValid = true;
+
+#if defined(CONFIG_ADC_ASYNC)
+	if (asyncEnabled)
+	{
+		k_sem_give(&asyncTickSem);
+		return;
+	}
+#endif
+	k_work_submit(&adcWorkHandler);
+}
+
+
+void AdcDtsTurnOff()
+{
+	atomic_clear(&samplingOn);
+	k_timer_stop(&adcSampleTimer);
+	LOG_INF("ADC turned off (sample timer stopped)");
+}
+
+//This function is only for when the adcInit has been called, and then the adcTurnOff was called
+void AdcDtsTurnOn()
+{
+	LOG_INF("ADC turned on (sample timer starting)");
+	//Starts at the burst period, so the initial values are reported quickly
+	atomic_set(&samplingOn, 1);
+	lastActivityTime = k_uptime_get();
+	startSampleTimer(true);
+}
+
+int initCtrlGpio()
+{
+	int err;
 
-		default:
-			LOG_ERR("Unknown input channel number!");
+	for (int i = 0; i < ADC_DTS_INPUT_COUNT; i++)
+	{
+		if (!gpio_is_ready_dt(&ctrl1Pins[i]) || !gpio_is_ready_dt(&ctrl2Pins[i])) 
+		{
+			LOG_ERR("Gpio not ready");
+			return -1;
+		}
+
+		err = gpio_pin_configure_dt(&ctrl1Pins[i], GPIO_OUTPUT_ACTIVE);
+		if (err < 0) 
+		{
+			LOG_ERR("Config failed");
+			return -1;
+		}
+		err = gpio_pin_configure_dt(&ctrl2Pins[i], GPIO_OUTPUT_ACTIVE);
+		if (err < 0) 
+		{
+			LOG_ERR("Config failed");
 			return -1;
-		break;
+		}
 	}
 	return 0;
 }
 
-int AdcDtsSetCtrl2(int inputChannel)
+static int setCtrlPin(const struct gpio_dt_spec *pPins, int inputChannel)
 {
 	int err;
-	switch(inputChannel)
-	{
-		case 0:
-			err = gpio_pin_set_dt(&a1ctrl2_pin,true);
-			if (err != 0)  	
-			{
-				LOG_ERR("Pin set failed");
-				return -1;
-			}
-		break;
 
-		case 1:
-			err = gpio_pin_set_dt(&a2ctrl2_pin,true);
-			if (err != 0) 
-			{
-				LOG_ERR("Pin set failed");
-				return -1;
-			}
-		break;
+	if (inputChannel < 0 || inputChannel >= ADC_DTS_INPUT_COUNT)
+	{
+		LOG_ERR("Unknown input channel number!");
+		return -1;
+	}
 
-		default:
-			LOG_ERR("Unknown input channel number!");
-			return -1;
-		break;
+	err = gpio_pin_set_dt(&pPins[inputChannel], true);
+	if (err != 0)  	
+	{
+		LOG_ERR("Pin set failed");
+		return -1;
 	}
 	return 0;
 }
+
+int AdcDtsSetCtrl1(int inputChannel)
+{
+	return setCtrlPin(ctrl1Pins, inputChannel);
+}
+
+int AdcDtsSetCtrl2(int inputChannel)
+{
+	return setCtrlPin(ctrl2Pins, inputChannel);
+}
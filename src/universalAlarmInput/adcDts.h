@@ -2,8 +2,58 @@
 #define ADC_DTS_H
 
 //Global macros used by the .c module which needs to easily be modified by the user
-#define ADC_SAMPLE_TIME_MS 100
-#define DEBOUNCE_TIMER_PERIOD_MS 100
+#define ADC_SAMPLE_TIME_MS 100 //Sampling period when the adaptive rate is disabled, and the default burst period
+
+//Adaptive sample rate, the ADC is sampled at the idle period while all channels are stable. Activity on any channel
+//switches to the burst period at once, the idle period is resumed after ADC_DTS_IDLE_HOLD_MS without activity
+#define ADC_DTS_ADAPTIVE_RATE 1
+#define ADC_DTS_BURST_PERIOD_MS ADC_SAMPLE_TIME_MS
+#define ADC_DTS_IDLE_PERIOD_MS 1000
+#define ADC_DTS_IDLE_HOLD_MS 3000
+#define ADC_DTS_MIN_PERIOD_MS 10
+#define ADC_DTS_MAX_PERIOD_MS 10000
+#define ADC_DTS_SCAN_MODE 1 //1: all channels are sampled in one sequence, 0: one adc_read per channel
+
+//Asynchronous acquisition, the scan is started with adc_read_async from a dedicated thread and the samples are
+//processed by a low priority thread, so the sampling cadence doesn't depend on the system workqueue (needs CONFIG_ADC_ASYNC)
+#define ADC_DTS_ASYNC_MODE 1
+#define ADC_DTS_ACQUISITION_STACK_SIZE 1024
+#define ADC_DTS_ACQUISITION_PRIORITY 2
+#define ADC_DTS_PROCESSING_STACK_SIZE 2048
+#define ADC_DTS_PROCESSING_PRIORITY 12
+
+//Default change detection used for channels without their own configuration
+#define ADC_DTS_DEFAULT_DEADBAND_ABS 8 //Raw counts
+#define ADC_DTS_DEFAULT_DEADBAND_REL_PERMILLE 10
+#define ADC_DTS_DEFAULT_MIN_EVENT_INTERVAL_MS 0
+#define ADC_DTS_DEFAULT_FILTER_TYPE ADC_FILTER_NONE
+#define ADC_DTS_DEFAULT_FILTER_LENGTH 1
+#define ADC_DTS_DEFAULT_OVERSAMPLING 0 //0: use the zephyr,oversampling property of the channel in the devicetree
+
+//Oversampling, the channel value is the average of 2^oversampling samples taken back to back in each sampling cycle.
+//In scan mode the whole scan is repeated and accumulated in software, the buffers are sized for the largest value
+#define ADC_DTS_MAX_OVERSAMPLING 8
+#define ADC_DTS_MAX_SCAN_OVERSAMPLING 4
+
+//Calibration, the offset and gain of each channel are applied to the samples before the filter and stored in settings
+#define ADC_DTS_SETTINGS_KEY "adc"
+#define ADC_DTS_SETTINGS_CALIBRATION_KEY "cal"
+#define ADC_DTS_CALIBRATION_SAMPLES 64 //Samples averaged by the offset and gain calibration
+#define ADC_DTS_GAIN_PPM_UNITY 1000000
+#define ADC_DTS_GAIN_PPM_MIN 800000 //Calibration results outside these limits are rejected as a wrong setup
+#define ADC_DTS_GAIN_PPM_MAX 1200000
+#define ADC_DTS_OFFSET_MAX 200 //Raw counts
+
+//Sample history, the latest raw samples of each channel are kept in a ring buffer. A capture trigger freezes a window
+//of the samples up to and including the trigger sample (pre) and the samples after it (post)
+#define ADC_DTS_HISTORY_SIZE 64
+#define ADC_DTS_CAPTURE_PRE_SAMPLES 32
+#define ADC_DTS_CAPTURE_POST_SAMPLES 16
+
+//Timing histograms, bucket 0 holds values below ADC_DTS_HISTOGRAM_FIRST_US, each following bucket doubles the limit
+//and the last bucket holds everything above
+#define ADC_DTS_HISTOGRAM_BUCKETS 8
+#define ADC_DTS_HISTOGRAM_FIRST_US 32
 
 #define ACTIVE_HIGH 0
 #define ACTIVE_LOW  1
@@ -14,6 +64,25 @@
 #include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <zephyr/devicetree.h>
+
+#include "adcFilter.h"
+
+//The inputs are described by the zephyr,user node. io-channels lists the ADC channels, input n is sampled on channel n.
+//ctrl1-gpios and ctrl2-gpios hold the mode control pins of each input, so their length sets the number of inputs, and
+//reference-channel is the io-channels index of the reference. Boards without ctrl1-gpios use the a1ctrl1..a2ctrl2
+//aliases of the original 2 input hardware
+#define ADC_DTS_USER_NODE DT_PATH(zephyr_user)
+#define ADC_DTS_CHANNEL_COUNT DT_PROP_LEN(ADC_DTS_USER_NODE, io_channels)
+
+#if DT_NODE_HAS_PROP(ADC_DTS_USER_NODE, ctrl1_gpios)
+#define ADC_DTS_INPUT_COUNT DT_PROP_LEN(ADC_DTS_USER_NODE, ctrl1_gpios)
+#else
+#define ADC_DTS_INPUT_COUNT 2
+#endif
+
+#define ADC_DTS_REFERENCE_CHANNEL DT_PROP_OR(ADC_DTS_USER_NODE, reference_channel, ADC_DTS_INPUT_COUNT)
+
 //Global variables that needs to be accessed outside the modules scope
 typedef enum 
 {
@@ -30,16 +99,132 @@ typedef struct
 
 typedef void(*analogInputEventHandler)(const AnalogInputEvent* event);
 
+//Filter and change detection of a channel. The samples are filtered before the change detection, a change event is
+//only raised when the filtered value has moved more than both deadbands from the last reported value, and at least
+//minEventIntervalMs after the previous event on the channel
+typedef struct
+{
+    uint16_t deadbandAbs; //Raw counts
+    uint16_t deadbandRelPermille; //Relative to the last reported value
+    uint16_t minEventIntervalMs;
+    AdcFilterType filterType;
+    uint8_t filterLength; //Window length, or the shift of the IIR filter (smoothing factor 1/2^length)
+    uint8_t oversampling; //2^oversampling samples are averaged per sampling cycle, see ADC_DTS_DEFAULT_OVERSAMPLING
+} AdcDtsChannelConfig;
+
+//Distribution of a measured delay in us
+typedef struct
+{
+    uint32_t count;
+    uint32_t minUs;
+    uint32_t maxUs;
+    uint32_t meanUs;
+    uint32_t histogram[ADC_DTS_HISTOGRAM_BUCKETS];
+} AdcDtsLatencyStats;
+
+//Time spent in the acquisition and processing of one sampling cycle (all channels)
+typedef struct
+{
+    uint32_t cycles;
+    uint32_t cycleTimeLastUs;
+    uint32_t cycleTimeAvgUs;
+    uint32_t cycleTimeMaxUs;
+    uint32_t overruns; //Samplings dropped because both buffers were waiting to be processed (async mode)
+    uint32_t samples[ADC_DTS_CHANNEL_COUNT]; //Raw samples per channel
+    uint32_t events[ADC_DTS_CHANNEL_COUNT]; //Events passed to the event handler per channel
+    bool scanMode; //True if all channels are sampled in one sequence
+    bool asyncMode; //True if the samples are acquired and processed outside the system workqueue
+    bool burstMode; //True while sampling at the burst period
+    uint32_t burstCycles; //Sampling cycles at the burst period
+    uint32_t sampleRateAvgMilliHz; //Average sampling rate since the sampling was first turned on
+    AdcDtsLatencyStats timerJitter; //Deviation of the time between two sample timer expiries from the period
+    AdcDtsLatencyStats startLatency; //From the timer expiry until the acquisition starts (workqueue or acquisition thread)
+    AdcDtsLatencyStats dispatchLatency; //From the timer expiry until an event is passed to the event handler
+} AdcDtsStats;
+
+//Correction of a channel: corrected = (raw - offset) * gainPpm / ADC_DTS_GAIN_PPM_UNITY
+typedef struct
+{
+    int16_t offset; //Raw counts
+    uint32_t gainPpm;
+} AdcDtsCalibration;
+
+//Raw sample in the history, the time is the low 16 bits of the uptime in ms (the sample period isn't fixed)
+typedef struct
+{
+    uint16_t timeMs;
+    int16_t value;
+} AdcDtsHistorySample;
+
+typedef struct
+{
+    uint32_t sequence; //Increased by each completed capture of the channel
+    int64_t triggerTime; //Uptime in ms
+    uint16_t count; //Samples in the window, fewer than the full window right after boot
+    uint16_t triggerIndex; //Position of the trigger sample in samples
+    AdcDtsHistorySample samples[ADC_DTS_CAPTURE_PRE_SAMPLES + ADC_DTS_CAPTURE_POST_SAMPLES];
+} AdcDtsCapture;
+
+//Sampling periods of the adaptive sample rate, idlePeriodMs equal to burstPeriodMs gives a fixed rate
+typedef struct
+{
+    uint16_t burstPeriodMs;
+    uint16_t idlePeriodMs;
+    uint16_t idleHoldMs; //Time without activity before going back to the idle period
+} AdcDtsRateConfig;
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 //Functions that should be accessible from the outside 
-int AdcDtsInit(analogInputEventHandler eventHandler);
+//pConfig is an array with a configuration for each channel, NULL uses the default configuration for all channels
+int AdcDtsInit(analogInputEventHandler eventHandler, const AdcDtsChannelConfig *pConfig);
+
+int AdcDtsSetChannelConfig(uint8_t channelNumber, const AdcDtsChannelConfig *pConfig);
+
+//The next sample of the channel is sent as ANALOG_INPUT_INIT_VALUE, also when it is within the deadband.
+//Used when the input is decoded in a new way, a stable input wouldn't send anything otherwise
+int AdcDtsRequestInitValue(uint8_t channelNumber);
 
 int AdcDtsStart();
 
 int AdcDtsGetSample(uint8_t channelNumber);
 
+//Latest reported value of the channel converted with the channel's gain and reference
+int AdcDtsGetMillivolts(uint8_t channelNumber, int32_t *pMillivolts);
+
+//Runs the ADC's own offset calibration, should be repeated if the temperature changes a lot
+int AdcDtsCalibrateInternal(void);
+
+//The input of the channel must be at 0 V while the offset is measured
+int AdcDtsCalibrateOffset(uint8_t channelNumber);
+
+//The input of the channel must be at referenceMv, the offset should be calibrated first
+int AdcDtsCalibrateGain(uint8_t channelNumber, int32_t referenceMv);
+
+int AdcDtsGetCalibration(uint8_t channelNumber, AdcDtsCalibration *pCalibration);
+
+//Starts a capture on the channel, the window is complete after ADC_DTS_CAPTURE_POST_SAMPLES more samples
+//Returns -EBUSY if a capture is already waiting for its post trigger samples
+int AdcDtsCaptureTrigger(uint8_t channelNumber);
+
+//Copy of the latest completed capture of the channel, -ENODATA if there is none
+int AdcDtsGetCapture(uint8_t channelNumber, AdcDtsCapture *pCapture);
+
+//Removes the correction of the channel, the change is stored by AdcDtsSaveCalibration
+int AdcDtsResetCalibration(uint8_t channelNumber);
+
+//Stores the calibration of all channels in settings, it's loaded again by AdcDtsInit
+int AdcDtsSaveCalibration(void);
+
+void AdcDtsGetStats(AdcDtsStats *pStats);
+
+//Clears the timing statistics, so a new baseline can be measured
+void AdcDtsResetTimingStats(void);
+
+//Periods must be within ADC_DTS_MIN_PERIOD_MS and ADC_DTS_MAX_PERIOD_MS, and the idle period can't be shorter than the burst period
+int AdcDtsSetRateConfig(const AdcDtsRateConfig *pConfig);
+
 //This function turns off the timers needed for the ADC and debounce to work
 void AdcDtsTurnOff();
 
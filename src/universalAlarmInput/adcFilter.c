@@ -0,0 +1,138 @@
+#include <errno.h>
+#include <string.h>
+
+#include "adcFilter.h"
+
+int AdcFilterInit(AdcFilter *pFilter, AdcFilterType type, uint8_t length)
+{
+	int err = 0;
+
+	memset(pFilter, 0, sizeof(*pFilter));
+
+	switch (type)
+	{
+		case ADC_FILTER_NONE:
+		break;
+
+		case ADC_FILTER_MOVING_AVERAGE:
+		case ADC_FILTER_MEDIAN:
+			if (length == 0 || length > ADC_FILTER_MAX_LENGTH)
+			{
+				err = -EINVAL;
+			}
+		break;
+
+		case ADC_FILTER_IIR:
+			if (length == 0 || length > ADC_FILTER_IIR_MAX_SHIFT)
+			{
+				err = -EINVAL;
+			}
+		break;
+
+		default:
+			err = -EINVAL;
+		break;
+	}
+
+	if (err == 0)
+	{
+		pFilter->type = type;
+		pFilter->length = length;
+	}
+	return err;
+}
+
+void AdcFilterReset(AdcFilter *pFilter)
+{
+	pFilter->count = 0;
+	pFilter->pos = 0;
+	pFilter->sum = 0;
+	pFilter->iirState = 0;
+}
+
+static int16_t movingAverageUpdate(AdcFilter *pFilter, int16_t sample)
+{
+	if (pFilter->count == pFilter->length)
+	{
+		pFilter->sum -= pFilter->window[pFilter->pos];
+	}
+	else
+	{
+		pFilter->count++;
+	}
+
+	pFilter->window[pFilter->pos] = sample;
+	pFilter->sum += sample;
+	pFilter->pos = (pFilter->pos + 1) % pFilter->length;
+
+	//Rounded to the nearest value, the sum is never negative for ADC samples clamped at zero
+	return (int16_t)((pFilter->sum + pFilter->count / 2) / pFilter->count);
+}
+
+static int16_t medianUpdate(AdcFilter *pFilter, int16_t sample)
+{
+	int16_t sorted[ADC_FILTER_MAX_LENGTH];
+	int16_t value;
+	int j;
+
+	if (pFilter->count < pFilter->length)
+	{
+		pFilter->count++;
+	}
+	pFilter->window[pFilter->pos] = sample;
+	pFilter->pos = (pFilter->pos + 1) % pFilter->length;
+
+	//Insertion sort, the window is at most ADC_FILTER_MAX_LENGTH samples
+	for (int i = 0; i < pFilter->count; i++)
+	{
+		value = pFilter->window[i];
+		for (j = i; j > 0 && sorted[j - 1] > value; j--)
+		{
+			sorted[j] = sorted[j - 1];
+		}
+		sorted[j] = value;
+	}
+
+	if (pFilter->count % 2 == 1)
+	{
+		return sorted[pFilter->count / 2];
+	}
+	return (int16_t)(((int32_t)sorted[pFilter->count / 2 - 1] + sorted[pFilter->count / 2] + 1) / 2);
+}
+
+//Single pole low pass: y += (x - y) / 2^shift, the state keeps ADC_FILTER_IIR_FRACTION_BITS extra bits
+static int16_t iirUpdate(AdcFilter *pFilter, int16_t sample)
+{
+	int32_t scaled = (int32_t)sample * (1 << ADC_FILTER_IIR_FRACTION_BITS);
+
+	if (pFilter->count == 0)
+	{
+		//Start at the first sample instead of ramping up from zero
+		pFilter->iirState = scaled;
+		pFilter->count = 1;
+	}
+	else
+	{
+		pFilter->iirState += (scaled - pFilter->iirState) / (1 << pFilter->length);
+	}
+
+	return (int16_t)((pFilter->iirState + (1 << (ADC_FILTER_IIR_FRACTION_BITS - 1))) / (1 << ADC_FILTER_IIR_FRACTION_BITS));
+}
+
+int16_t AdcFilterUpdate(AdcFilter *pFilter, int16_t sample)
+{
+	switch (pFilter->type)
+	{
+		case ADC_FILTER_MOVING_AVERAGE:
+			return movingAverageUpdate(pFilter, sample);
+
+		case ADC_FILTER_MEDIAN:
+			return medianUpdate(pFilter, sample);
+
+		case ADC_FILTER_IIR:
+			return iirUpdate(pFilter, sample);
+
+		default:
+			return sample;
+	}
+}
@@ -0,0 +1,52 @@
+#ifndef ADC_FILTER_H
+#define ADC_FILTER_H
+
+//Global macros used by the .c module which needs to easily be modified by the user
+#define ADC_FILTER_MAX_LENGTH 16       //Largest window of the moving average and median filters
+#define ADC_FILTER_IIR_MAX_SHIFT 8     //Slowest IIR filter, the smoothing factor is 1/2^shift
+#define ADC_FILTER_IIR_FRACTION_BITS 8 //Fraction bits of the IIR filter state, avoids the truncation bias of a plain shift
+
+//Include libraries needed for the header to compile, often simple libraries like inttypes.h
+#include <inttypes.h>
+#include <stdint.h>
+
+//Global variables that needs to be accessed outside the modules scope
+typedef enum
+{
+	ADC_FILTER_NONE,
+	ADC_FILTER_MOVING_AVERAGE,
+	ADC_FILTER_MEDIAN,
+	ADC_FILTER_IIR
+} AdcFilterType;
+
+//Integer only filter state, one per channel
+typedef struct
+{
+	AdcFilterType type;
+	uint8_t length; //Window length of the moving average and median filters, shift of the IIR filter
+	uint8_t count; //Samples in the window, the output of the first samples is based on the samples received so far
+	uint8_t pos;
+	int32_t sum;
+	int32_t iirState;
+	int16_t window[ADC_FILTER_MAX_LENGTH];
+} AdcFilter;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+//Functions that should be accessible from the outside 
+
+//Returns -EINVAL if the length isn't valid for the filter type, the filter is then set to ADC_FILTER_NONE
+int AdcFilterInit(AdcFilter *pFilter, AdcFilterType type, uint8_t length);
+
+//Forget the previous samples, the next sample starts the filter again
+void AdcFilterReset(AdcFilter *pFilter);
+
+//Add a sample and return the filtered value
+int16_t AdcFilterUpdate(AdcFilter *pFilter, int16_t sample);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //ADC_FILTER_H
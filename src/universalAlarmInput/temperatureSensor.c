@@ -0,0 +1,153 @@
+#include <stddef.h>
+
+#include "temperatureSensor.h"
+#include "universalAlarmInput.h" //INPUT_PULLUP_OHM
+
+//The tables hold the ratio Rsensor / (Rpullup + Rsensor) in Q15 for a set of temperatures, in ascending ratio order.
+//The ratios are calculated by the compiler from the sensor resistance, so only integer math is left at runtime
+#define RATIO_Q15_MILLIOHM(milliOhm) \
+	((uint16_t)(((uint64_t)(milliOhm) << 15) / ((uint64_t)INPUT_PULLUP_OHM * 1000 + (milliOhm))))
+
+typedef struct
+{
+	uint16_t ratioQ15;
+	int16_t centiDegrees;
+} TemperatureTableEntry;
+
+//10k NTC with B = 3950 (R25 = 10 kOhm), resistance from the B equation in 5 degree steps
+#define NTC_ENTRY(ohm, degrees) {RATIO_Q15_MILLIOHM((uint64_t)(ohm) * 1000), (degrees) * 100}
+
+static const TemperatureTableEntry ntc10kB3950Table[] =
+{
+	NTC_ENTRY(359, 125),
+	NTC_ENTRY(407, 120),
+	NTC_ENTRY(463, 115),
+	NTC_ENTRY(529, 110),
+	NTC_ENTRY(606, 105),
+	NTC_ENTRY(698, 100),
+	NTC_ENTRY(805, 95),
+	NTC_ENTRY(934, 90),
+	NTC_ENTRY(1087, 85),
+	NTC_ENTRY(1270, 80),
+	NTC_ENTRY(1492, 75),
+	NTC_ENTRY(1760, 70),
+	NTC_ENTRY(2086, 65),
+	NTC_ENTRY(2486, 60),
+	NTC_ENTRY(2978, 55),
+	NTC_ENTRY(3588, 50),
+	NTC_ENTRY(4348, 45),
+	NTC_ENTRY(5301, 40),
+	NTC_ENTRY(6506, 35),
+	NTC_ENTRY(8037, 30),
+	NTC_ENTRY(10000, 25),
+	NTC_ENTRY(12535, 20),
+	NTC_ENTRY(15837, 15),
+	NTC_ENTRY(20175, 10),
+	NTC_ENTRY(25925, 5),
+	NTC_ENTRY(33621, 0),
+	NTC_ENTRY(44026, -5),
+	NTC_ENTRY(58246, -10),
+	NTC_ENTRY(77898, -15),
+	NTC_ENTRY(105385, -20),
+	NTC_ENTRY(144317, -25),
+	NTC_ENTRY(200204, -30),
+	NTC_ENTRY(281577, -35),
+	NTC_ENTRY(401860, -40),
+};
+
+//PT1000 after IEC 60751, R = 1000 * (1 + A*t + B*t^2) with A = 3.9083e-3 and B = -5.775e-7 (the C term below 0 degrees is
+//left out, it's below 0.01 degrees at -50). The resistance is calculated in milliohm by the compiler
+#define PT1000_MILLIOHM(degrees) ((10000000000LL + 39083000LL * (degrees) - 5775LL * (degrees) * (degrees)) / 10000)
+#define PT1000_ENTRY(degrees) {RATIO_Q15_MILLIOHM(PT1000_MILLIOHM(degrees)), (degrees) * 100}
+
+static const TemperatureTableEntry pt1000Table[] =
+{
+	PT1000_ENTRY(-50),
+	PT1000_ENTRY(-40),
+	PT1000_ENTRY(-30),
+	PT1000_ENTRY(-20),
+	PT1000_ENTRY(-10),
+	PT1000_ENTRY(0),
+	PT1000_ENTRY(10),
+	PT1000_ENTRY(20),
+	PT1000_ENTRY(30),
+	PT1000_ENTRY(40),
+	PT1000_ENTRY(50),
+	PT1000_ENTRY(60),
+	PT1000_ENTRY(70),
+	PT1000_ENTRY(80),
+	PT1000_ENTRY(90),
+	PT1000_ENTRY(100),
+	PT1000_ENTRY(110),
+	PT1000_ENTRY(120),
+	PT1000_ENTRY(130),
+	PT1000_ENTRY(140),
+	PT1000_ENTRY(150),
+	PT1000_ENTRY(160),
+	PT1000_ENTRY(170),
+	PT1000_ENTRY(180),
+	PT1000_ENTRY(190),
+	PT1000_ENTRY(200),
+};
+
+TemperatureSensorStatus TemperatureSensorConvert(TemperatureSensorType type, uint16_t value, uint16_t reference, int16_t *pCentiDegrees)
+{
+	const TemperatureTableEntry *pTable;
+	size_t count;
+	size_t low;
+	size_t high;
+	size_t mid;
+	uint32_t ratio;
+
+	switch (type)
+	{
+		case TEMPERATURE_SENSOR_NTC_10K_B3950:
+			pTable = ntc10kB3950Table;
+			count = sizeof(ntc10kB3950Table) / sizeof(ntc10kB3950Table[0]);
+		break;
+
+		case TEMPERATURE_SENSOR_PT1000:
+			pTable = pt1000Table;
+			count = sizeof(pt1000Table) / sizeof(pt1000Table[0]);
+		break;
+
+		default:
+			return TEMPERATURE_SENSOR_OPEN;
+	}
+
+	if (reference == 0)
+	{
+		return TEMPERATURE_SENSOR_OPEN;
+	}
+
+	ratio = ((uint32_t)value << 15) / reference;
+	if (ratio < pTable[0].ratioQ15)
+	{
+		return TEMPERATURE_SENSOR_SHORT;
+	}
+	if (ratio > pTable[count - 1].ratioQ15)
+	{
+		return TEMPERATURE_SENSOR_OPEN;
+	}
+
+	//Binary search for the segment with pTable[low].ratioQ15 <= ratio <= pTable[low + 1].ratioQ15
+	low = 0;
+	high = count - 1;
+	while (high - low > 1)
+	{
+		mid = (low + high) / 2;
+		if (ratio < pTable[mid].ratioQ15)
+		{
+			high = mid;
+		}
+		else
+		{
+			low = mid;
+		}
+	}
+
+	//Linear interpolation in the segment
+	*pCentiDegrees = pTable[low].centiDegrees + (int16_t)(((int32_t)(pTable[high].centiDegrees - pTable[low].centiDegrees) *
+		(int32_t)(ratio - pTable[low].ratioQ15)) / (int32_t)(pTable[high].ratioQ15 - pTable[low].ratioQ15));
+	return TEMPERATURE_SENSOR_OK;
+}
@@ -0,0 +1,35 @@
+#ifndef TEMPERATURE_SENSOR_H
+#define TEMPERATURE_SENSOR_H
+
+//Include libraries needed for the header to compile, often simple libraries like inttypes.h
+#include <inttypes.h>
+#include <stdint.h>
+
+//Global variables that needs to be accessed outside the modules scope
+typedef enum
+{
+	TEMPERATURE_SENSOR_NTC_10K_B3950, //-40 to 125 degrees
+	TEMPERATURE_SENSOR_PT1000         //-50 to 200 degrees
+} TemperatureSensorType;
+
+typedef enum
+{
+	TEMPERATURE_SENSOR_OK,
+	TEMPERATURE_SENSOR_OPEN,  //Above the sensor table, a cut wire
+	TEMPERATURE_SENSOR_SHORT  //Below the sensor table, a shorted wire
+} TemperatureSensorStatus;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+//Functions that should be accessible from the outside 
+
+//Converts a sample of the sensor voltage to centi degrees Celsius, ratiometric against the reference sample (pull up voltage)
+//The temperature is only written when TEMPERATURE_SENSOR_OK is returned
+TemperatureSensorStatus TemperatureSensorConvert(TemperatureSensorType type, uint16_t value, uint16_t reference, int16_t *pCentiDegrees);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //TEMPERATURE_SENSOR_H
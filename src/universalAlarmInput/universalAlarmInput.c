@@ -1,60 +1,498 @@
 #include "universalAlarmInput.h"
 #include "stdint.h"
+#include <stdlib.h>
+#include <string.h>
 #include <zephyr/kernel.h>
 #include <zephyr/logging/log.h>
+#include <zephyr/settings/settings.h>
 #include "adcDts.h"
+#include "temperatureSensor.h"
 
 LOG_MODULE_REGISTER(universalInputs, CONFIG_LOG_DEFAULT_LEVEL);
 
-#define DIGITAL_THRESHOLD 100
-
 static InputEventHandlerFunc pInputEventHandler;
 static bool initDone = 0;
 
 static InputMode inputMode[MAX_UIE_INPUTS];
 static InputValue currentValue[MAX_UIE_INPUTS];
+static bool inputDecoded[MAX_UIE_INPUTS]; //False until the first state after a mode change has been sent
+static TemperatureSensorStatus temperatureStatus[MAX_UIE_INPUTS];
+static VoltageRange voltageRange[MAX_UIE_INPUTS];
+
+static InputConfig inputConfig[MAX_UIE_INPUTS]; //Applied configuration, the thresholds and times are used from here
+static InputConfig storedConfig[MAX_UIE_INPUTS];
+static bool storedConfigValid;
+
+//Input configuration as stored in settings
+typedef struct
+{
+	uint8_t version; //UIE_SETTINGS_CONFIG_VERSION
+	InputConfig config[MAX_UIE_INPUTS];
+} InputConfigRecord;
+
+//Debounce of the digital inputs, a changed state is qualified by a delayed work item
+typedef struct
+{
+	struct k_work_delayable work;
+	uint8_t inputNo;
+	bool level;      //Level of the input after the threshold hysteresis
+	bool qualifying; //A new state is waiting for its qualification time
+	uint32_t suppressed;
+} InputDebounce;
+
+static InputDebounce inputDebounce[MAX_UIE_INPUTS];
+static struct k_spinlock inputLock; //Debounce state and the applied configuration
+
+static int InputSettingsSet(const char *name, size_t len, settings_read_cb read_cb, void *cb_arg);
+
+static struct settings_handler inputSettingsHandler = {
+	.name = UIE_SETTINGS_KEY,
+	.h_get = NULL,
+	.h_set = InputSettingsSet,
+	.h_commit = NULL,
+	.h_export = NULL
+};
+
+BUILD_ASSERT(DIGITAL_THRESHOLD_LOW < DIGITAL_THRESHOLD_HIGH, "The digital thresholds need a hysteresis");
+
+BUILD_ASSERT(VOLTAGE_DIVIDER_OUTPUT_OHM > 0 && VOLTAGE_DIVIDER_FULL_OHM >= VOLTAGE_DIVIDER_OUTPUT_OHM, "Invalid voltage divider");
 
 static uint16_t inputReference;			// Reference value for the input when calculating impedance values (pull up voltage)
 
 // TODO: Fix this, 
 extern int8_t alarmIdGlobal;
 
+//Loop resistance bands of a supervised mode in ascending resistance. The limits are the ratio
+//Rloop / (Rpullup + Rloop) in Q15, so a sample is in a band when value * 2^15 < upperQ15 * inputReference.
+//The last band has no upper limit
+#define SUPERVISED_BAND_COUNT 4
+#define RATIO_Q15(ohm) ((uint16_t)(((uint64_t)(ohm) << 15) / (INPUT_PULLUP_OHM + (ohm))))
+#define SUPERVISED_BANDS(lowOhm, lowState, highOhm, highState) \
+	{ \
+		{RATIO_Q15(SUPERVISED_SHORT_OHM), SUPERVISED_STATE_TAMPER_SHORT}, \
+		{(RATIO_Q15(lowOhm) + RATIO_Q15(highOhm)) / 2, lowState}, \
+		{RATIO_Q15(SUPERVISED_OPEN_OHM), highState}, \
+		{0, SUPERVISED_STATE_TAMPER_OPEN}, \
+	}
+
+typedef struct
+{
+	uint16_t upperQ15;
+	SupervisedState state;
+} SupervisedBand;
+
+static const SupervisedBand parallelBands[SUPERVISED_BAND_COUNT] =
+	SUPERVISED_BANDS(SUPERVISED_PARALLEL_ALARM_OHM, SUPERVISED_STATE_ALARM, SUPERVISED_PARALLEL_NORMAL_OHM, SUPERVISED_STATE_NORMAL);
+static const SupervisedBand serialBands[SUPERVISED_BAND_COUNT] =
+	SUPERVISED_BANDS(SUPERVISED_SERIAL_NORMAL_OHM, SUPERVISED_STATE_NORMAL, SUPERVISED_SERIAL_ALARM_OHM, SUPERVISED_STATE_ALARM);
+static const SupervisedBand serialParallelBands[SUPERVISED_BAND_COUNT] =
+	SUPERVISED_BANDS(SUPERVISED_SERIAL_PARALLEL_NORMAL_OHM, SUPERVISED_STATE_NORMAL, SUPERVISED_SERIAL_PARALLEL_ALARM_OHM, SUPERVISED_STATE_ALARM);
+
+BUILD_ASSERT(SUPERVISED_SHORT_OHM < MIN(SUPERVISED_PARALLEL_ALARM_OHM, SUPERVISED_SERIAL_NORMAL_OHM) &&
+	SUPERVISED_SHORT_OHM < SUPERVISED_SERIAL_PARALLEL_NORMAL_OHM, "The short limit must be below all loop resistances");
+BUILD_ASSERT(SUPERVISED_OPEN_OHM > MAX(SUPERVISED_PARALLEL_NORMAL_OHM, SUPERVISED_SERIAL_ALARM_OHM) &&
+	SUPERVISED_OPEN_OHM > SUPERVISED_SERIAL_PARALLEL_ALARM_OHM, "The open limit must be above all loop resistances");
+
+static const SupervisedBand *SupervisedBandsGet(InputMode mode)
+{
+	switch (mode)
+	{
+		case UIM_SUPERVISED_INPUT_PARALLEL:
+			return parallelBands;
+
+		case UIM_SUPERVISED_INPUT_SERIAL:
+			return serialBands;
+
+		case UIM_SUPERVISED_INPUT_SERIAL_PARALLEL:
+			return serialParallelBands;
+
+		default:
+			return NULL;
+	}
+}
+
+static SupervisedState SupervisedStateDecode(const SupervisedBand *pBands, uint16_t value)
+{
+	uint32_t scaledValue = (uint32_t)value << 15;
+
+	for (int i = 0; i < SUPERVISED_BAND_COUNT - 1; i++)
+	{
+		if (scaledValue < (uint32_t)pBands[i].upperQ15 * inputReference)
+		{
+			return pBands[i].state;
+		}
+	}
+	return pBands[SUPERVISED_BAND_COUNT - 1].state;
+}
+
+static bool IsSupervisedMode(InputMode mode)
+{
+	return SupervisedBandsGet(mode) != NULL;
+}
+
+//Snapshot of the mode of an input. The mode is changed from the twin while the samples are decoded on the ADC
+//thread, so a sample is decoded with one snapshot from start to end
+static InputMode InputModeGet(uint8_t inputNo)
+{
+	k_spinlock_key_t key;
+	InputMode mode;
+
+	key = k_spin_lock(&inputLock);
+	mode = inputMode[inputNo];
+	k_spin_unlock(&inputLock, key);
+	return mode;
+}
+
+//Decodes a supervised input, returns the event to send (UIE_NULL if the state hasn't changed)
+static InputEventType HandleSupervisedInput(uint8_t inputNo, InputMode mode, uint16_t value, bool init, InputValue *pValue)
+{
+	SupervisedState state;
+
+	//The loop can't be decoded until the pull up voltage is known, the inputs are decoded again when it is
+	if (inputReference == 0)
+	{
+		return UIE_NULL;
+	}
+
+	state = SupervisedStateDecode(SupervisedBandsGet(mode), value);
+	if (state == currentValue[inputNo].uValue && !init && inputDecoded[inputNo])
+	{
+		return UIE_NULL;
+	}
+	currentValue[inputNo].uValue = state;
+	inputDecoded[inputNo] = true;
+	LOG_INF("Input %d supervised state %d by analog value %d (reference %d)", inputNo, state, value, inputReference);
+
+	if (state == SUPERVISED_STATE_TAMPER_OPEN || state == SUPERVISED_STATE_TAMPER_SHORT)
+	{
+		pValue->uValue = state;
+		return UIE_INPUT_FAULT;
+	}
+	pValue->bValue = state == SUPERVISED_STATE_ALARM;
+	return UIE_INPUT_CHANGED;
+}
+
+static void SendInputEvent(uint8_t inputNo, InputMode mode, InputEventType event, InputValue value)
+{
+	InputEvent inputEvent =
+	{
+		.inputNo = inputNo,
+		.event = event,
+		.mode = mode,
+		.value = value,
+		.range = voltageRange[inputNo]
+	};
+
+	(*pInputEventHandler)(&inputEvent);
+}
+
+static bool IsDigitalMode(InputMode mode)
+{
+	return mode == UIM_DIGITAL_INPUT_NO || mode == UIM_DIGITAL_INPUT_NC;
+}
+
+//State of a digital input from the level, NO inputs are active when pulled low
+static bool DigitalInputActive(uint8_t inputNo, InputMode mode)
+{
+	return mode == UIM_DIGITAL_INPUT_NO ? !inputDebounce[inputNo].level : inputDebounce[inputNo].level;
+}
+
+//Debounces a digital input, returns the event to send (UIE_NULL until a new state has been stable for the qualification time)
+static InputEventType HandleDigitalInput(uint8_t inputNo, InputMode mode, uint16_t value, bool init, InputValue *pValue)
+{
+	InputDebounce *pDebounce = &inputDebounce[inputNo];
+	InputEventType event = UIE_NULL;
+	k_spinlock_key_t key;
+	uint16_t qualifyMs;
+	bool active;
+
+	key = k_spin_lock(&inputLock);
+	if (value > DIGITAL_THRESHOLD_HIGH)
+	{
+		pDebounce->level = true;
+	}
+	else if (value < DIGITAL_THRESHOLD_LOW)
+	{
+		pDebounce->level = false;
+	}
+	active = DigitalInputActive(inputNo, mode);
+
+	if (active == currentValue[inputNo].bValue && !init && inputDecoded[inputNo])
+	{
+		//Back to the sent state before the new state was qualified
+		if (pDebounce->qualifying)
+		{
+			pDebounce->qualifying = false;
+			pDebounce->suppressed++;
+			(void)k_work_cancel_delayable(&pDebounce->work);
+		}
+	}
+	else
+	{
+		qualifyMs = active ? inputConfig[inputNo].assertMs : inputConfig[inputNo].releaseMs;
+		if (init || !inputDecoded[inputNo] || qualifyMs == 0)
+		{
+			pDebounce->qualifying = false;
+			(void)k_work_cancel_delayable(&pDebounce->work);
+			currentValue[inputNo].bValue = active;
+			inputDecoded[inputNo] = true;
+			pValue->bValue = active;
+			event = UIE_INPUT_CHANGED;
+		}
+		else if (!pDebounce->qualifying)
+		{
+			pDebounce->qualifying = true;
+			(void)k_work_reschedule(&pDebounce->work, K_MSEC(qualifyMs));
+		}
+	}
+	k_spin_unlock(&inputLock, key);
+
+	if (event != UIE_NULL)
+	{
+		LOG_INF("Input %d %s changed to %s by analog value %d", inputNo, mode == UIM_DIGITAL_INPUT_NO ? "NO" : "NC",
+			active ? "Active" : "Inactive", value);
+	}
+	return event;
+}
+
+//The qualification time of a new digital state has passed without the input returning
+static void DebounceWorkHandler(struct k_work *work)
+{
+	struct k_work_delayable *pWork = k_work_delayable_from_work(work);
+	InputDebounce *pDebounce = CONTAINER_OF(pWork, InputDebounce, work);
+	uint8_t inputNo = pDebounce->inputNo;
+	InputValue value = {0};
+	bool send = false;
+	k_spinlock_key_t key;
+	InputMode mode;
+
+	key = k_spin_lock(&inputLock);
+	mode = inputMode[inputNo];
+	if (pDebounce->qualifying && IsDigitalMode(mode))
+	{
+		pDebounce->qualifying = false;
+		value.bValue = DigitalInputActive(inputNo, mode);
+		if (value.bValue != currentValue[inputNo].bValue)
+		{
+			currentValue[inputNo].bValue = value.bValue;
+			send = true;
+		}
+	}
+	k_spin_unlock(&inputLock, key);
+
+	if (send)
+	{
+		LOG_INF("Input %d changed to %s after debounce", inputNo, value.bValue ? "Active" : "Inactive");
+
+		//Keep the analog waveform around the change, the pre trigger samples hold the bounces
+		(void)AdcDtsCaptureTrigger(inputNo);
+		SendInputEvent(inputNo, mode, UIE_INPUT_CHANGED, value);
+	}
+}
+
+static bool IsTemperatureMode(InputMode mode)
+{
+	return mode == UIM_TEMPERATURE_NTC || mode == UIM_TEMPERATURE_PTC;
+}
+
+//Converts a temperature input, returns the event to send (UIE_NULL if the change is below the delta)
+static InputEventType HandleTemperatureInput(uint8_t inputNo, InputMode mode, uint16_t value, bool init, InputValue *pValue)
+{
+	TemperatureSensorStatus status;
+	int16_t centiDegrees;
+
+	//The sensor can't be converted until the pull up voltage is known, the inputs are converted again when it is
+	if (inputReference == 0)
+	{
+		return UIE_NULL;
+	}
+
+	status = TemperatureSensorConvert(mode == UIM_TEMPERATURE_NTC ? TEMPERATURE_SENSOR_NTC_10K_B3950 : TEMPERATURE_SENSOR_PT1000,
+		value, inputReference, &centiDegrees);
+	if (status != TEMPERATURE_SENSOR_OK)
+	{
+		if (status == temperatureStatus[inputNo] && !init && inputDecoded[inputNo])
+		{
+			return UIE_NULL;
+		}
+		temperatureStatus[inputNo] = status;
+		inputDecoded[inputNo] = true;
+		LOG_WRN("Input %d temperature sensor %s by analog value %d (reference %d)", inputNo,
+			status == TEMPERATURE_SENSOR_OPEN ? "open" : "shorted", value, inputReference);
+
+		pValue->uValue = status == TEMPERATURE_SENSOR_OPEN ? SUPERVISED_STATE_TAMPER_OPEN : SUPERVISED_STATE_TAMPER_SHORT;
+		return UIE_INPUT_FAULT;
+	}
+
+	if (temperatureStatus[inputNo] == TEMPERATURE_SENSOR_OK && !init && inputDecoded[inputNo] &&
+		abs(centiDegrees - currentValue[inputNo].iValue) < inputConfig[inputNo].temperatureDeltaCenti)
+	{
+		return UIE_NULL;
+	}
+	currentValue[inputNo].iValue = centiDegrees;
+	temperatureStatus[inputNo] = TEMPERATURE_SENSOR_OK;
+	inputDecoded[inputNo] = true;
+	LOG_INF("Input %d temperature %d centi degrees by analog value %d (reference %d)", inputNo, centiDegrees, value, inputReference);
+
+	pValue->iValue = centiDegrees;
+	return UIE_INPUT_CHANGED;
+}
+
+//Voltage at the input in millivolts from a sample of the channel
+static int VoltageInputMillivolts(uint8_t inputNo, uint16_t value, uint32_t *pMillivolts)
+{
+	uint64_t millivolts;
+
+#if VOLTAGE_RATIOMETRIC
+	//Scaled against the reference, so the ADC reference and gain errors cancel out
+	if (inputReference == 0)
+	{
+		return -EAGAIN;
+	}
+	millivolts = ((uint64_t)value * VOLTAGE_REFERENCE_MV) / inputReference;
+#else
+	int32_t adcMillivolts;
+	int err;
+
+	//The latest sample of the channel, which is the value
+	ARG_UNUSED(value);
+	err = AdcDtsGetMillivolts(inputNo, &adcMillivolts);
+	if (err < 0)
+	{
+		return err;
+	}
+	millivolts = MAX(adcMillivolts, 0);
+#endif
+
+	millivolts = (millivolts * VOLTAGE_DIVIDER_FULL_OHM) / VOLTAGE_DIVIDER_OUTPUT_OHM;
+	*pMillivolts = MIN(millivolts, UINT16_MAX);
+	return 0;
+}
+
+static VoltageRange VoltageRangeDecode(const InputConfig *pThresholds, VoltageRange range, uint32_t millivolts)
+{
+	//The range is only left when the voltage is the hysteresis inside the threshold
+	if (range == VOLTAGE_RANGE_LOW && millivolts < (uint32_t)pThresholds->lowMv + pThresholds->hysteresisMv)
+	{
+		return VOLTAGE_RANGE_LOW;
+	}
+	if (range == VOLTAGE_RANGE_HIGH && millivolts + pThresholds->hysteresisMv > pThresholds->highMv)
+	{
+		return VOLTAGE_RANGE_HIGH;
+	}
+
+	if (millivolts < pThresholds->lowMv)
+	{
+		return VOLTAGE_RANGE_LOW;
+	}
+	if (millivolts > pThresholds->highMv)
+	{
+		return VOLTAGE_RANGE_HIGH;
+	}
+	return VOLTAGE_RANGE_NORMAL;
+}
+
+//Measures a voltage input, returns the event to send (UIE_NULL if the range hasn't changed)
+static InputEventType HandleVoltageInput(uint8_t inputNo, uint16_t value, bool init, InputValue *pValue)
+{
+	VoltageRange range;
+	uint32_t millivolts;
+
+	if (VoltageInputMillivolts(inputNo, value, &millivolts) < 0)
+	{
+		return UIE_NULL;
+	}
+	currentValue[inputNo].uValue = millivolts;
+
+	range = VoltageRangeDecode(&inputConfig[inputNo], voltageRange[inputNo], millivolts);
+	if (range == voltageRange[inputNo] && !init && inputDecoded[inputNo])
+	{
+		return UIE_NULL;
+	}
+	voltageRange[inputNo] = range;
+	inputDecoded[inputNo] = true;
+	LOG_INF("Input %d voltage range %d at %d mV by analog value %d", inputNo, range, millivolts, value);
+
+	pValue->uValue = millivolts;
+	return UIE_INPUT_CHANGED;
+}
+
+//The supervised, temperature and ratiometric voltage inputs are decoded against the reference, a new reference can
+//change their values
+static void ReferenceChanged(void)
+{
+	InputEventType event;
+	InputValue value;
+	InputMode mode;
+	int sample;
+
+	for (int i = 0; i < MAX_UIE_INPUTS; i++)
+	{
+		mode = InputModeGet(i);
+		if (!IsSupervisedMode(mode) && !IsTemperatureMode(mode) && !(VOLTAGE_RATIOMETRIC && mode == UIM_VOLTAGE_INPUT))
+		{
+			continue;
+		}
+
+		sample = AdcDtsGetSample(i);
+		if (sample < 0)
+		{
+			continue;
+		}
+
+		if (IsSupervisedMode(mode))
+		{
+			event = HandleSupervisedInput(i, mode, sample, false, &value);
+		}
+		else if (IsTemperatureMode(mode))
+		{
+			event = HandleTemperatureInput(i, mode, sample, false, &value);
+		}
+		else
+		{
+			event = HandleVoltageInput(i, sample, false, &value);
+		}
+		if (event != UIE_NULL)
+		{
+			SendInputEvent(i, mode, event, value);
+		}
+	}
+}
+
 void HandleInputEvent(const AnalogInputEvent* pEvent)
 {
 	InputEvent inputEvent = 
 	{
 		.event = UIE_NULL
 	};
+	InputMode mode;
 
 	// OBS: It is important that inputNo has been validated before calling this function
-	switch (inputMode[pEvent->inputNo])
+	mode = InputModeGet(pEvent->inputNo);
+	switch (mode)
 	{
 		case UIM_UNDEFINED:
 			// Unconfigured input
 			break;
 
-		case  UIM_DIGITAL_INPUT_NO:
-			bool noValue = pEvent->value > DIGITAL_THRESHOLD ? false : true;
-			if (noValue != currentValue[pEvent->inputNo].bValue || pEvent->event == ANALOG_INPUT_INIT_VALUE)
-			{
-				currentValue[pEvent->inputNo].bValue = noValue;
+		case UIM_DIGITAL_INPUT_NO:
+		case UIM_DIGITAL_INPUT_NC:
+			inputEvent.event = HandleDigitalInput(pEvent->inputNo, mode, pEvent->value, pEvent->event == ANALOG_INPUT_INIT_VALUE, &inputEvent.value);
+			break;
 
-				LOG_INF("Input %d NO changed to %s by analog value %d", pEvent->inputNo, noValue == true ? "Active" : "Inactive", pEvent->value);
-				inputEvent.value.bValue = noValue;
-				inputEvent.event = UIE_INPUT_CHANGED;
-			}
+		case UIM_SUPERVISED_INPUT_PARALLEL:
+		case UIM_SUPERVISED_INPUT_SERIAL:
+		case UIM_SUPERVISED_INPUT_SERIAL_PARALLEL:
+			inputEvent.event = HandleSupervisedInput(pEvent->inputNo, mode, pEvent->value, pEvent->event == ANALOG_INPUT_INIT_VALUE, &inputEvent.value);
 			break;
 
-		case UIM_DIGITAL_INPUT_NC:
-			bool ncValue = pEvent->value > DIGITAL_THRESHOLD ? true : false;
-			if (ncValue != currentValue[pEvent->inputNo].bValue || pEvent->event == ANALOG_INPUT_INIT_VALUE)
-			{
-				currentValue[pEvent->inputNo].bValue = ncValue;
-				
-				LOG_INF("Input %d NC changed to %s by analog value %d", pEvent->inputNo, ncValue == true ? "Active" : "Inactive", pEvent->value);
-				inputEvent.value.bValue = ncValue;
-				inputEvent.event = UIE_INPUT_CHANGED;
-			}
+		case UIM_VOLTAGE_INPUT:
+			inputEvent.event = HandleVoltageInput(pEvent->inputNo, pEvent->value, pEvent->event == ANALOG_INPUT_INIT_VALUE, &inputEvent.value);
+			break;
+
+		case UIM_TEMPERATURE_NTC:
+		case UIM_TEMPERATURE_PTC:
+			inputEvent.event = HandleTemperatureInput(pEvent->inputNo, mode, pEvent->value, pEvent->event == ANALOG_INPUT_INIT_VALUE, &inputEvent.value);
 			break;
 
 		default:
@@ -62,11 +500,16 @@ void HandleInputEvent(const AnalogInputEvent* pEvent)
 			break;
 	}
 	
+	//Keep the analog waveform around the change, it can be fetched from the cloud. Temperatures change too slowly to be of interest
+	if ((inputEvent.event == UIE_INPUT_CHANGED || inputEvent.event == UIE_INPUT_FAULT) && pEvent->event == ANALOG_INPUT_CHANGED &&
+		!IsTemperatureMode(mode))
+	{
+		(void)AdcDtsCaptureTrigger(pEvent->inputNo);
+	}
+
 	if (inputEvent.event != UIE_NULL)
 	{
-		inputEvent.inputNo = pEvent->inputNo;
-		inputEvent.mode = inputMode[pEvent->inputNo];
-		(*pInputEventHandler)(&inputEvent);
+		SendInputEvent(pEvent->inputNo, mode, inputEvent.event, inputEvent.value);
 	}
 }
 
@@ -80,8 +523,9 @@ static void AdcInputChangedCb(const AnalogInputEvent* event)
 			{
 				if (event->event == ANALOG_INPUT_INIT_VALUE || event->event == ANALOG_INPUT_CHANGED)
 				{
-					// TODO: Add filter
+					//Filtered by the ADC module
 					inputReference = event->value;
+					ReferenceChanged();
 				}
 			}
 			else
@@ -104,10 +548,155 @@ static void AdcInputChangedCb(const AnalogInputEvent* event)
 }
 
 
+static void InputConfigDefault(InputConfig *pConfig)
+{
+	pConfig->mode = INPUT_DEFAULT_MODE;
+	pConfig->assertMs = DEBOUNCE_DEFAULT_ASSERT_MS;
+	pConfig->releaseMs = DEBOUNCE_DEFAULT_RELEASE_MS;
+	pConfig->lowMv = VOLTAGE_DEFAULT_LOW_MV;
+	pConfig->highMv = VOLTAGE_DEFAULT_HIGH_MV;
+	pConfig->hysteresisMv = VOLTAGE_DEFAULT_HYSTERESIS_MV;
+	pConfig->temperatureDeltaCenti = TEMPERATURE_DEFAULT_DELTA_CENTI;
+	pConfig->filterType = INPUT_FILTER_MODE_DEFAULT;
+	pConfig->filterLength = 0;
+}
+
+static bool InputConfigValid(const InputConfig *pConfig)
+{
+	AdcFilter filter;
+
+	if (pConfig->mode > UIM_TEMPERATURE_PTC || pConfig->lowMv >= pConfig->highMv)
+	{
+		return false;
+	}
+	return pConfig->filterType == INPUT_FILTER_MODE_DEFAULT || AdcFilterInit(&filter, pConfig->filterType, pConfig->filterLength) == 0;
+}
+
+//Compared field by field, the padding of InputConfig isn't initialized when a configuration is assigned
+static bool InputConfigEqual(const InputConfig *pA, const InputConfig *pB)
+{
+	return pA->mode == pB->mode && pA->assertMs == pB->assertMs && pA->releaseMs == pB->releaseMs &&
+		pA->lowMv == pB->lowMv && pA->highMv == pB->highMv && pA->hysteresisMv == pB->hysteresisMv &&
+		pA->temperatureDeltaCenti == pB->temperatureDeltaCenti && pA->filterType == pB->filterType &&
+		pA->filterLength == pB->filterLength;
+}
+
+static int InputSettingsSet(const char *name, size_t len, settings_read_cb read_cb, void *cb_arg)
+{
+	const char *next;
+	InputConfigRecord record;
+	int rc;
+
+	if (!settings_name_steq(name, UIE_SETTINGS_CONFIG_KEY, &next) || next)
+	{
+		return -ENOENT;
+	}
+
+	//Stored with a different number of inputs, or before the record had a version
+	if (len != sizeof(record))
+	{
+		LOG_WRN("Stored input configuration doesn't match the inputs, not used");
+		return -EINVAL;
+	}
+
+	rc = read_cb(cb_arg, &record, sizeof(record));
+	if (rc < 0)
+	{
+		return rc;
+	}
+
+	if (record.version != UIE_SETTINGS_CONFIG_VERSION)
+	{
+		LOG_WRN("Stored input configuration version %d isn't supported, not used", record.version);
+		return -EINVAL;
+	}
+
+	for (int i = 0; i < MAX_UIE_INPUTS; i++)
+	{
+		if (InputConfigValid(&record.config[i]))
+		{
+			inputConfig[i] = record.config[i];
+			LOG_INF("Input %d stored configuration: mode %d", i, record.config[i].mode);
+		}
+		else
+		{
+			LOG_WRN("Input %d stored configuration isn't valid, not used", i);
+		}
+	}
+	memcpy(storedConfig, record.config, sizeof(storedConfig));
+	storedConfigValid = true;
+	return 0;
+}
+
+//Change detection of an input channel in the ADC module for the input mode, and the filter if one is configured
+static void InputChannelConfigGet(const InputConfig *pInputConfig, AdcDtsChannelConfig *pConfig)
+{
+	InputMode mode = pInputConfig->mode;
+
+	if (IsTemperatureMode(mode))
+	{
+		pConfig->deadbandAbs = TEMPERATURE_DEADBAND_ABS;
+		pConfig->deadbandRelPermille = 0;
+		pConfig->minEventIntervalMs = TEMPERATURE_MIN_EVENT_INTERVAL_MS;
+		pConfig->filterType = TEMPERATURE_FILTER_TYPE;
+		pConfig->filterLength = TEMPERATURE_FILTER_LENGTH;
+		pConfig->oversampling = TEMPERATURE_OVERSAMPLING;
+	}
+	else if (mode == UIM_VOLTAGE_INPUT)
+	{
+		//Analog noise is filtered here, the thresholds only see the filtered voltage
+		pConfig->deadbandAbs = ADC_DTS_DEFAULT_DEADBAND_ABS;
+		pConfig->deadbandRelPermille = ADC_DTS_DEFAULT_DEADBAND_REL_PERMILLE;
+		pConfig->minEventIntervalMs = VOLTAGE_MIN_EVENT_INTERVAL_MS;
+		pConfig->filterType = VOLTAGE_FILTER_TYPE;
+		pConfig->filterLength = VOLTAGE_FILTER_LENGTH;
+		pConfig->oversampling = INPUT_OVERSAMPLING;
+	}
+	else
+	{
+		pConfig->deadbandAbs = ADC_DTS_DEFAULT_DEADBAND_ABS;
+		pConfig->deadbandRelPermille = ADC_DTS_DEFAULT_DEADBAND_REL_PERMILLE;
+		pConfig->minEventIntervalMs = 0;
+		pConfig->filterType = INPUT_FILTER_TYPE;
+		pConfig->filterLength = INPUT_FILTER_LENGTH;
+		pConfig->oversampling = INPUT_OVERSAMPLING;
+	}
+
+	if (pInputConfig->filterType != INPUT_FILTER_MODE_DEFAULT)
+	{
+		pConfig->filterType = pInputConfig->filterType;
+		pConfig->filterLength = pInputConfig->filterLength;
+	}
+}
+
 // Initialize the inputs
 void UniversalAlarmInputInit(InputEventHandlerFunc eventHandler)
 {
    int result;
+   AdcDtsChannelConfig adcChannelConfig[ADC_DTS_CHANNEL_COUNT];
+   InputConfig defaultConfig;
+
+	InputConfigDefault(&defaultConfig);
+
+	//Alarm inputs report every change outside the noise deadband at once, the reference only changes slowly
+	for (int i = 0; i < ADC_DTS_CHANNEL_COUNT; i++)
+	{
+		InputChannelConfigGet(&defaultConfig, &adcChannelConfig[i]);
+		if (i == REFERENCE_INPUT)
+		{
+			adcChannelConfig[i].minEventIntervalMs = REFERENCE_MIN_EVENT_INTERVAL_MS;
+			adcChannelConfig[i].filterType = REFERENCE_FILTER_TYPE;
+			adcChannelConfig[i].filterLength = REFERENCE_FILTER_LENGTH;
+			adcChannelConfig[i].oversampling = REFERENCE_OVERSAMPLING;
+		}
+	}
+
+	for (int i = 0; i < MAX_UIE_INPUTS; i++)
+	{
+		InputConfigDefault(&inputConfig[i]);
+		inputDebounce[i].inputNo = i;
+		k_work_init_delayable(&inputDebounce[i].work, DebounceWorkHandler);
+	}
 
 	LOG_INF("Initializing inputs");
 
@@ -115,30 +704,30 @@ void UniversalAlarmInputInit(InputEventHandlerFunc eventHandler)
 
 	//Init the ADC with a callback function that needs to be called on a change on the input
 	//This function also inits the ctrl signals, however they still need to be set using the: "setAlarmMode()" function
-	result = AdcDtsInit(AdcInputChangedCb);
+	result = AdcDtsInit(AdcInputChangedCb, adcChannelConfig);
 	if (result < 0) 
 	{
 		LOG_ERR("Could not init sequence");
       return;
 	}
 
-	//Set the alarm mode, see adc module for available modes
-	// TODO: Set input type from configuration
-/*
-	result = setAlarmMode(UIM_DIGITAL_INPUT_NC, 1);
-	if (result < 0) 
+	//Set the stored configuration, the defaults are used for inputs without one. The settings subsystem was
+	//initialized by the ADC module
+	result = settings_register(&inputSettingsHandler);
+	if (result == 0)
+	{
+		result = settings_load_subtree(UIE_SETTINGS_KEY);
+	}
+	if (result < 0)
 	{
-		LOG_ERR("Could not init ctrl gpio");
+		LOG_ERR("Could not load the input configuration (Error: %d)", result);
 	}
 
-	result = setAlarmMode(UIM_DIGITAL_INPUT_NC,2);
-	if (result < 0) 
+	for (int i = 0; i < MAX_UIE_INPUTS; i++)
 	{
-		LOG_ERR("Could not init ctrl gpio");
+		UniversalAlarmInputSetMode(i, inputConfig[i].mode);
 	}
 
-	k_sleep(K_MSEC(10));
-*/
 	//Setup the different settings for each channel
 	//AnalogInputSetInputSettings(1, 8, ACTIVE_HIGH, 100);
 	//AnalogInputSetInputSettings(2, 8, ACTIVE_HIGH, 100);
@@ -156,12 +745,31 @@ void UniversalAlarmInputStart()
 void UniversalAlarmInputSetMode(uint8_t inputNo, InputMode mode)
 {
 	int err;
+	AdcDtsChannelConfig adcChannelConfig;
+	k_spinlock_key_t key;
 
 	if (inputNo < MAX_UIE_INPUTS)
 	{
 		LOG_INF("Setting mode for input %d to %d", inputNo, mode);
 
+		key = k_spin_lock(&inputLock);
 		inputMode[inputNo] = mode;
+		inputConfig[inputNo].mode = mode;
+		inputDecoded[inputNo] = false;
+		inputDebounce[inputNo].qualifying = false;
+		(void)k_work_cancel_delayable(&inputDebounce[inputNo].work);
+		k_spin_unlock(&inputLock, key);
+		temperatureStatus[inputNo] = TEMPERATURE_SENSOR_OK;
+		voltageRange[inputNo] = VOLTAGE_RANGE_NORMAL;
+
+		//Temperatures need the resolution more than the response time
+		InputChannelConfigGet(&inputConfig[inputNo], &adcChannelConfig);
+		err = AdcDtsSetChannelConfig(inputNo, &adcChannelConfig);
+		if (err != 0)
+		{
+			LOG_ERR("Failed to set the ADC channel config for input %d, error: %d", inputNo, err);
+		}
+
 		switch(mode)
 		{
 			case UIM_DIGITAL_INPUT_NO:
@@ -201,6 +809,9 @@ void UniversalAlarmInputSetMode(uint8_t inputNo, InputMode mode)
 		{
 			LOG_ERR("Failed to set mode for input %d, error: %d", inputNo, err);
 		}
+
+		//The input is decoded again in the new mode from the next sample, on the ADC thread like all samples
+		(void)AdcDtsRequestInitValue(inputNo);
 	}
 	else
 	{
@@ -209,3 +820,172 @@ void UniversalAlarmInputSetMode(uint8_t inputNo, InputMode mode)
 	}
 }
 
+int UniversalAlarmInputSetConfig(uint8_t inputNo, const InputConfig *pConfig)
+{
+	AdcDtsChannelConfig adcChannelConfig;
+	k_spinlock_key_t key;
+	bool modeChanged;
+	int err = 0;
+
+	if (inputNo >= MAX_UIE_INPUTS || pConfig == NULL)
+	{
+		LOG_ERR("Invalid input number: %d", inputNo);
+		return -EINVAL;
+	}
+	if (!InputConfigValid(pConfig))
+	{
+		LOG_ERR("Invalid configuration for input %d", inputNo);
+		return -EINVAL;
+	}
+
+	key = k_spin_lock(&inputLock);
+	modeChanged = pConfig->mode != inputMode[inputNo];
+	inputConfig[inputNo] = *pConfig;
+	k_spin_unlock(&inputLock, key);
+
+	//A new mode starts the decoding of the input over, otherwise only the filter and the thresholds are changed
+	if (modeChanged)
+	{
+		UniversalAlarmInputSetMode(inputNo, pConfig->mode);
+	}
+	else
+	{
+		InputChannelConfigGet(pConfig, &adcChannelConfig);
+		err = AdcDtsSetChannelConfig(inputNo, &adcChannelConfig);
+		if (err != 0)
+		{
+			LOG_ERR("Failed to set the ADC channel config for input %d, error: %d", inputNo, err);
+		}
+	}
+	return err;
+}
+
+int UniversalAlarmInputGetConfig(uint8_t inputNo, InputConfig *pConfig)
+{
+	k_spinlock_key_t key;
+
+	if (inputNo >= MAX_UIE_INPUTS || pConfig == NULL)
+	{
+		LOG_ERR("Invalid input number: %d", inputNo);
+		return -EINVAL;
+	}
+
+	key = k_spin_lock(&inputLock);
+	*pConfig = inputConfig[inputNo];
+	k_spin_unlock(&inputLock, key);
+	return 0;
+}
+
+int UniversalAlarmInputSaveConfig(void)
+{
+	InputConfigRecord record;
+	k_spinlock_key_t key;
+	bool changed = !storedConfigValid;
+	int err;
+
+	//Zeroed so the padding written to flash is the same every time
+	memset(&record, 0, sizeof(record));
+	record.version = UIE_SETTINGS_CONFIG_VERSION;
+
+	key = k_spin_lock(&inputLock);
+	for (int i = 0; i < MAX_UIE_INPUTS; i++)
+	{
+		record.config[i].mode = inputConfig[i].mode;
+		record.config[i].assertMs = inputConfig[i].assertMs;
+		record.config[i].releaseMs = inputConfig[i].releaseMs;
+		record.config[i].lowMv = inputConfig[i].lowMv;
+		record.config[i].highMv = inputConfig[i].highMv;
+		record.config[i].hysteresisMv = inputConfig[i].hysteresisMv;
+		record.config[i].temperatureDeltaCenti = inputConfig[i].temperatureDeltaCenti;
+		record.config[i].filterType = inputConfig[i].filterType;
+		record.config[i].filterLength = inputConfig[i].filterLength;
+	}
+	k_spin_unlock(&inputLock, key);
+
+	//Saves flash writes when the twin is received again without changes
+	for (int i = 0; i < MAX_UIE_INPUTS && !changed; i++)
+	{
+		changed = !InputConfigEqual(&record.config[i], &storedConfig[i]);
+	}
+	if (!changed)
+	{
+		return 0;
+	}
+
+	err = settings_save_one(UIE_SETTINGS_KEY "/" UIE_SETTINGS_CONFIG_KEY, &record, sizeof(record));
+	if (err)
+	{
+		LOG_ERR("Input configuration settings_save_one failed (err %d)", err);
+		return err;
+	}
+	memcpy(storedConfig, record.config, sizeof(storedConfig));
+	storedConfigValid = true;
+	LOG_INF("Input configuration stored");
+	return 0;
+}
+
+int UniversalAlarmInputSetDebounce(uint8_t inputNo, uint16_t assertMs, uint16_t releaseMs)
+{
+	k_spinlock_key_t key;
+
+	if (inputNo >= MAX_UIE_INPUTS)
+	{
+		LOG_ERR("Invalid input number: %d", inputNo);
+		return -EINVAL;
+	}
+
+	//A qualification in progress keeps its time
+	key = k_spin_lock(&inputLock);
+	inputConfig[inputNo].assertMs = assertMs;
+	inputConfig[inputNo].releaseMs = releaseMs;
+	k_spin_unlock(&inputLock, key);
+	return 0;
+}
+
+uint32_t UniversalAlarmInputGetSuppressedCount(uint8_t inputNo)
+{
+	if (inputNo >= MAX_UIE_INPUTS)
+	{
+		return 0;
+	}
+	return inputDebounce[inputNo].suppressed;
+}
+
+int UniversalAlarmInputSetTemperatureDelta(uint8_t inputNo, uint16_t deltaCenti)
+{
+	k_spinlock_key_t key;
+
+	if (inputNo >= MAX_UIE_INPUTS)
+	{
+		LOG_ERR("Invalid input number: %d", inputNo);
+		return -EINVAL;
+	}
+
+	key = k_spin_lock(&inputLock);
+	inputConfig[inputNo].temperatureDeltaCenti = deltaCenti;
+	k_spin_unlock(&inputLock, key);
+	return 0;
+}
+
+int UniversalAlarmInputSetVoltageThresholds(uint8_t inputNo, uint16_t lowMv, uint16_t highMv, uint16_t hysteresisMv)
+{
+	k_spinlock_key_t key;
+
+	if (inputNo >= MAX_UIE_INPUTS)
+	{
+		LOG_ERR("Invalid input number: %d", inputNo);
+		return -EINVAL;
+	}
+	if (lowMv >= highMv)
+	{
+		LOG_ERR("Invalid voltage thresholds for input %d: %d mV - %d mV", inputNo, lowMv, highMv);
+		return -EINVAL;
+	}
+
+	key = k_spin_lock(&inputLock);
+	inputConfig[inputNo].lowMv = lowMv;
+	inputConfig[inputNo].highMv = highMv;
+	inputConfig[inputNo].hysteresisMv = hysteresisMv;
+	k_spin_unlock(&inputLock, key);
+	return 0;
+}
@@ -2,15 +2,83 @@
 #define UNIVERSAL_ALARM_INPUT_H
 
 //Global macros used by the .c module which needs to easily be modified by the user
-// Number of universal inputs
-#define MAX_UIE_INPUTS 2
+// Number of universal inputs, from the devicetree (see adcDts.h)
+#define MAX_UIE_INPUTS ADC_DTS_INPUT_COUNT
+
+// Mode of the inputs until a configuration has been stored
+#define INPUT_DEFAULT_MODE UIM_DIGITAL_INPUT_NC
+
+// The applied configuration of the inputs is stored in settings under UIE_SETTINGS_KEY/UIE_SETTINGS_CONFIG_KEY
+#define UIE_SETTINGS_KEY "uie"
+#define UIE_SETTINGS_CONFIG_KEY "cfg"
+#define UIE_SETTINGS_CONFIG_VERSION 1 //Increase when InputConfig changes, a stored configuration of another version isn't used
+#define INPUT_FILTER_MODE_DEFAULT 0xFF //Filter type of an input using the filter of its mode
 
 // Which input no. is used for reference (not included in the normal universal inputs)
-#define REFERENCE_INPUT 2
+#define REFERENCE_INPUT ADC_DTS_REFERENCE_CHANNEL
+#define REFERENCE_MIN_EVENT_INTERVAL_MS 1000 //Minimum time between updates of the reference value
+
+//Digital inputs, the level is high above DIGITAL_THRESHOLD_HIGH and low below DIGITAL_THRESHOLD_LOW (raw counts).
+//A new state must be stable for the assert (inactive to active) or release (active to inactive) time before it's sent,
+//transitions that return before that are suppressed and counted
+#define DIGITAL_THRESHOLD_HIGH 120
+#define DIGITAL_THRESHOLD_LOW 80
+#define DEBOUNCE_DEFAULT_ASSERT_MS 200
+#define DEBOUNCE_DEFAULT_RELEASE_MS 500
+
+//Filters of the ADC samples, see adcFilter.h for the available types
+#define INPUT_FILTER_TYPE ADC_FILTER_MEDIAN //Removes single sample glitches on the alarm loops
+#define INPUT_FILTER_LENGTH 3
+#define REFERENCE_FILTER_TYPE ADC_FILTER_IIR
+#define REFERENCE_FILTER_LENGTH 3 //Smoothing factor 1/8
+
+//Oversampling of the ADC samples, 2^n samples are averaged each sampling cycle
+#define INPUT_OVERSAMPLING 0 //Devicetree value, the alarm loops need the response time more than the resolution
+#define REFERENCE_OVERSAMPLING 3
+
+//Pull up of every universal input to the reference, must match the hardware. The supervised loops and the
+//temperature sensors are decoded ratiometrically against the reference so the result doesn't depend on the supply
+#define INPUT_PULLUP_OHM 4700
+#define SUPERVISED_SHORT_OHM 200    //Below this the loop is shorted (tamper)
+#define SUPERVISED_OPEN_OHM 30000   //Above this the loop is cut (tamper)
+//Parallel: the closed contact puts a resistor across the EOL resistor
+#define SUPERVISED_PARALLEL_NORMAL_OHM 4700
+#define SUPERVISED_PARALLEL_ALARM_OHM 2350
+//Serial: the opened contact adds a resistor in series with the EOL resistor
+#define SUPERVISED_SERIAL_NORMAL_OHM 2200
+#define SUPERVISED_SERIAL_ALARM_OHM 4400
+//Serial and parallel (double EOL): EOL resistor in series with the contact and its alarm resistor in parallel
+#define SUPERVISED_SERIAL_PARALLEL_NORMAL_OHM 4700
+#define SUPERVISED_SERIAL_PARALLEL_ALARM_OHM 6900
+
+//Temperature inputs are converted ratiometrically with the sensor tables in temperatureSensor.c, the temperature is sent
+//as iValue in centi degrees. NTC mode is a 10k B3950 NTC, PTC mode a PT1000
+#define TEMPERATURE_DEFAULT_DELTA_CENTI 50 //A new temperature is only sent when it differs this much from the last one sent
+#define TEMPERATURE_DEADBAND_ABS 0 //Every count is passed on (rate limited below), the delta above decides what is sent
+#define TEMPERATURE_MIN_EVENT_INTERVAL_MS 1000
+#define TEMPERATURE_FILTER_TYPE ADC_FILTER_IIR
+#define TEMPERATURE_FILTER_LENGTH 2 //Smoothing factor 1/4
+#define TEMPERATURE_OVERSAMPLING REFERENCE_OVERSAMPLING //In scan mode this can't be above the highest oversampling at init
+
+//Voltage inputs are measured through the divider on the zephyr,user node (voltage-divider-full-ohms and
+//voltage-divider-output-ohms, Vin = Vadc * full / output). With reference-millivolts (the reference input voltage at
+//the ADC pin) the input is scaled ratiometrically against the reference input, otherwise against the ADC reference
+#define VOLTAGE_DIVIDER_FULL_OHM DT_PROP_OR(ADC_DTS_USER_NODE, voltage_divider_full_ohms, 1)
+#define VOLTAGE_DIVIDER_OUTPUT_OHM DT_PROP_OR(ADC_DTS_USER_NODE, voltage_divider_output_ohms, 1)
+#define VOLTAGE_RATIOMETRIC DT_NODE_HAS_PROP(ADC_DTS_USER_NODE, reference_millivolts)
+#define VOLTAGE_REFERENCE_MV DT_PROP_OR(ADC_DTS_USER_NODE, reference_millivolts, 0)
+//Thresholds in millivolts at the input, 0 disables the low and UINT16_MAX the high threshold
+#define VOLTAGE_DEFAULT_LOW_MV 0
+#define VOLTAGE_DEFAULT_HIGH_MV UINT16_MAX
+#define VOLTAGE_DEFAULT_HYSTERESIS_MV 100 //The voltage must be this far inside the range before the range is left
+#define VOLTAGE_MIN_EVENT_INTERVAL_MS 500
+#define VOLTAGE_FILTER_TYPE ADC_FILTER_IIR
+#define VOLTAGE_FILTER_LENGTH 3 //Smoothing factor 1/8
 
 //Include libraries needed for the header to compile, often simple libraries like inttypes.h
 #include <stdint.h>
 #include <stdbool.h>
+#include "adcDts.h"
 
 //Global variables that needs to be accessed outside the modules scope
 // Universal input modes
@@ -36,6 +104,24 @@ typedef enum
    UIE_INPUT_FAULT
 } InputEventType;
 
+// States of a supervised input, sent as uValue. Tamper states are sent as UIE_INPUT_FAULT
+// A temperature sensor outside its table is also sent as UIE_INPUT_FAULT with the tamper open or short state
+typedef enum
+{
+   SUPERVISED_STATE_NORMAL,
+   SUPERVISED_STATE_ALARM,
+   SUPERVISED_STATE_TAMPER_OPEN,
+   SUPERVISED_STATE_TAMPER_SHORT
+} SupervisedState;
+
+// Range of a voltage input, a voltage event is only sent when the range changes
+typedef enum
+{
+   VOLTAGE_RANGE_NORMAL,
+   VOLTAGE_RANGE_LOW,
+   VOLTAGE_RANGE_HIGH
+} VoltageRange;
+
 typedef union universalInputsValue
 {
    uint16_t uValue;
@@ -49,8 +135,23 @@ typedef struct
    InputEventType event;
    InputMode mode;
    InputValue value;
+   VoltageRange range; //Voltage inputs only, the value is the voltage in millivolts
 } InputEvent;
 
+// Configuration of an input, everything can be changed while the inputs are running
+typedef struct
+{
+   InputMode mode;
+   uint16_t assertMs;              //Debounce of the digital modes
+   uint16_t releaseMs;
+   uint16_t lowMv;                 //Range of the voltage mode
+   uint16_t highMv;
+   uint16_t hysteresisMv;
+   uint16_t temperatureDeltaCenti; //Change before a new temperature is sent
+   uint8_t filterType;             //AdcFilterType (see adcFilter.h) or INPUT_FILTER_MODE_DEFAULT
+   uint8_t filterLength;
+} InputConfig;
+
 // Universal input event handler
 typedef void(*InputEventHandlerFunc)(const InputEvent* event);
 
@@ -61,7 +162,7 @@ extern "C" {
 // Universal input event handler
 typedef void(*InputEventHandlerFunc)(const InputEvent* event);
 
-// Initialize the inputs
+// Initialize the inputs, the stored configuration is applied
 void UniversalAlarmInputInit(InputEventHandlerFunc eventHandler);
 
 // Start processing the inputs
@@ -70,6 +171,27 @@ void UniversalAlarmInputStart();
 // Set mode for the input
 void UniversalAlarmInputSetMode(uint8_t inputNo, InputMode mode);
 
+// Apply a configuration to an input, the configuration is validated first (-EINVAL)
+int UniversalAlarmInputSetConfig(uint8_t inputNo, const InputConfig *pConfig);
+
+// Get the applied configuration of an input
+int UniversalAlarmInputGetConfig(uint8_t inputNo, InputConfig *pConfig);
+
+// Store the applied configuration of the inputs, nothing is written if it hasn't changed since it was stored
+int UniversalAlarmInputSaveConfig(void);
+
+// Set the debounce times of a digital input, 0 sends the state on the first sample
+int UniversalAlarmInputSetDebounce(uint8_t inputNo, uint16_t assertMs, uint16_t releaseMs);
+
+// Number of transitions of a digital input that were suppressed by the debounce
+uint32_t UniversalAlarmInputGetSuppressedCount(uint8_t inputNo);
+
+// Set the change in centi degrees needed before a new temperature is sent for a temperature input
+int UniversalAlarmInputSetTemperatureDelta(uint8_t inputNo, uint16_t deltaCenti);
+
+// Set the range of a voltage input in millivolts, the hysteresis applies when the range is left
+int UniversalAlarmInputSetVoltageThresholds(uint8_t inputNo, uint16_t lowMv, uint16_t highMv, uint16_t hysteresisMv);
+
 #ifdef __cplusplus
 }
 #endif
@@ -126,6 +126,42 @@ int ButtonsHandlerInit(buttonsHandlerEventCb eventHandler)
 
 }
 
+//Read the state of a button directly, this can be used before the module is initialized (button held at boot)
+//Returns 1 if the button is pressed, 0 if not and a negative error code on failure
+int ButtonsHandlerIsPressed(uint8_t buttonId)
+{
+    int err;
+    const struct gpio_dt_spec *button;
+
+    switch (buttonId)
+    {
+        case 0:
+            button = &button0;
+        break;
+
+        case 1:
+            button = &button1;
+        break;
+
+        default:
+            return -EINVAL;
+    }
+
+    if (!device_is_ready(button->port)) 
+    {
+        return -ENODEV;
+    }
+
+    err = gpio_pin_configure_dt(button, GPIO_INPUT);
+    if (err < 0) 
+    {
+        LOG_ERR("Failed to configure button pin: %d", err);
+        return err;
+    }
+
+    return gpio_pin_get_dt(button);
+}
+
 int ButtonsHandlerStart(gpio_flags_t interruptMode)
 {
  //Enable the button interrupt
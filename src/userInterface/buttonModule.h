@@ -34,6 +34,8 @@ int ButtonsHandlerStart(gpio_flags_t interruptMode);
 
 int ButtonsHandlerStop(void);
 
+int ButtonsHandlerIsPressed(uint8_t buttonId);
+
 #ifdef __cplusplus
 }
 #endif
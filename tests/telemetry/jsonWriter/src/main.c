@@ -0,0 +1,242 @@
+#include <string.h>
+#include <errno.h>
+#include <zephyr/kernel.h>
+#include <zephyr/ztest.h>
+#include <cJSON.h>
+
+#include "jsonWriter.h"
+
+#define BENCHMARK_ALARMS 4
+#define BENCHMARK_ROUNDS 100
+
+static char buffer[1024];
+
+ZTEST(json_writer, test_object_members)
+{
+	JsonWriter writer;
+
+	JsonWriterInit(&writer, buffer, sizeof(buffer));
+	JsonWriterObjectStart(&writer, NULL);
+	JsonWriterAddString(&writer, "name", "Input \"1\"\n");
+	JsonWriterAddInt(&writer, "priority", -5);
+	JsonWriterAddBool(&writer, "active", true);
+	JsonWriterAddDecimal(&writer, "temp", -105, 1);
+	JsonWriterAddDecimal(&writer, "small", -5, 2);
+	JsonWriterObjectEnd(&writer);
+
+	zassert_true(JsonWriterFinish(&writer) > 0, "Valid document rejected");
+	zassert_str_equal(buffer, "{\"name\":\"Input \\\"1\\\"\\n\",\"priority\":-5,\"active\":true,\"temp\":-10.5,\"small\":-0.05}");
+}
+
+ZTEST(json_writer, test_array_elements_have_no_key)
+{
+	JsonWriter writer;
+
+	JsonWriterInit(&writer, buffer, sizeof(buffer));
+	JsonWriterObjectStart(&writer, NULL);
+	JsonWriterArrayStart(&writer, "values");
+	JsonWriterAddInt(&writer, NULL, 1);
+	JsonWriterAddInt(&writer, "ignored", 2);
+	JsonWriterObjectStart(&writer, "ignored");
+	JsonWriterAddInt(&writer, "a", 3);
+	JsonWriterObjectEnd(&writer);
+	JsonWriterArrayEnd(&writer);
+	JsonWriterObjectEnd(&writer);
+
+	zassert_true(JsonWriterFinish(&writer) > 0, "Valid document rejected");
+	zassert_str_equal(buffer, "{\"values\":[1,2,{\"a\":3}]}");
+}
+
+ZTEST(json_writer, test_nesting_errors)
+{
+	JsonWriter writer;
+
+	//Object member without a key
+	JsonWriterInit(&writer, buffer, sizeof(buffer));
+	JsonWriterObjectStart(&writer, NULL);
+	JsonWriterAddInt(&writer, NULL, 1);
+	JsonWriterObjectEnd(&writer);
+	zassert_equal(JsonWriterFinish(&writer), -EINVAL);
+
+	//Mismatched container
+	JsonWriterInit(&writer, buffer, sizeof(buffer));
+	JsonWriterObjectStart(&writer, NULL);
+	JsonWriterArrayEnd(&writer);
+	zassert_equal(JsonWriterFinish(&writer), -EINVAL);
+
+	//Unterminated
+	JsonWriterInit(&writer, buffer, sizeof(buffer));
+	JsonWriterObjectStart(&writer, NULL);
+	zassert_equal(JsonWriterFinish(&writer), -EINVAL);
+
+	//Too deep
+	JsonWriterInit(&writer, buffer, sizeof(buffer));
+	for (int i = 0; i < JSON_WRITER_MAX_DEPTH; i++)
+	{
+		JsonWriterArrayStart(&writer, NULL);
+	}
+	zassert_true(writer.error, "Nesting beyond the maximum depth not detected");
+}
+
+ZTEST(json_writer, test_overflow_reports_required_size)
+{
+	static const char expected[] = "{\"alarmId\":\"123456789\"}";
+	char smallBuffer[8];
+	JsonWriter writer;
+
+	JsonWriterInit(&writer, smallBuffer, sizeof(smallBuffer));
+	JsonWriterObjectStart(&writer, NULL);
+	JsonWriterAddString(&writer, "alarmId", "123456789");
+	JsonWriterObjectEnd(&writer);
+
+	zassert_equal(JsonWriterFinish(&writer), -ENOMEM);
+	zassert_equal(JsonWriterRequiredSize(&writer), sizeof(expected));
+	zassert_equal(strlen(smallBuffer), sizeof(smallBuffer) - 1, "The truncated document must be terminated");
+	zassert_mem_equal(smallBuffer, expected, sizeof(smallBuffer) - 1);
+}
+
+//Benchmark against the cJSON path the telemetry builders used before, with the heap use of cJSON counted by its hooks
+typedef struct
+{
+	size_t size;
+} HeapHeader;
+
+static size_t heapInUse;
+static size_t heapPeak;
+static uint32_t heapAllocations;
+
+static void *CountingMalloc(size_t size)
+{
+	HeapHeader *pHeader = k_malloc(sizeof(HeapHeader) + size);
+
+	if (pHeader == NULL)
+	{
+		return NULL;
+	}
+	pHeader->size = size;
+	heapInUse += size;
+	heapPeak = MAX(heapPeak, heapInUse);
+	heapAllocations++;
+	return pHeader + 1;
+}
+
+static void CountingFree(void *ptr)
+{
+	HeapHeader *pHeader;
+
+	if (ptr == NULL)
+	{
+		return;
+	}
+	pHeader = (HeapHeader *)ptr - 1;
+	heapInUse -= pHeader->size;
+	k_free(pHeader);
+}
+
+//A heartbeat with alarms, the shape of the largest telemetry message
+static int BuildWithCJson(char *pBuffer, size_t bufferSize)
+{
+	cJSON *root = cJSON_CreateObject();
+	cJSON *alarms;
+	cJSON *alarm;
+	bool printed;
+
+	if (root == NULL)
+	{
+		return -ENOMEM;
+	}
+
+	cJSON_AddStringToObject(root, "deviceId", "PAM8053_1040");
+	cJSON_AddNumberToObject(root, "rsrp", -97);
+	cJSON_AddNumberToObject(root, "band", 20);
+	alarms = cJSON_AddArrayToObject(root, "alarms");
+	for (int i = 0; alarms != NULL && i < BENCHMARK_ALARMS; i++)
+	{
+		alarm = cJSON_CreateObject();
+		if (alarm == NULL)
+		{
+			break;
+		}
+		cJSON_AddStringToObject(alarm, "alarmId", "20261017T120000U0");
+		cJSON_AddStringToObject(alarm, "name", "Input 1");
+		cJSON_AddNumberToObject(alarm, "priority", i + 1);
+		cJSON_AddStringToObject(alarm, "text", "Active");
+		cJSON_AddItemToArray(alarms, alarm);
+	}
+
+	printed = cJSON_PrintPreallocated(root, pBuffer, bufferSize, false);
+	cJSON_Delete(root);
+	return printed ? (int)strlen(pBuffer) : -ENOMEM;
+}
+
+static int BuildWithWriter(char *pBuffer, size_t bufferSize)
+{
+	JsonWriter writer;
+
+	JsonWriterInit(&writer, pBuffer, bufferSize);
+	JsonWriterObjectStart(&writer, NULL);
+	JsonWriterAddString(&writer, "deviceId", "PAM8053_1040");
+	JsonWriterAddInt(&writer, "rsrp", -97);
+	JsonWriterAddInt(&writer, "band", 20);
+	JsonWriterArrayStart(&writer, "alarms");
+	for (int i = 0; i < BENCHMARK_ALARMS; i++)
+	{
+		JsonWriterObjectStart(&writer, NULL);
+		JsonWriterAddString(&writer, "alarmId", "20261017T120000U0");
+		JsonWriterAddString(&writer, "name", "Input 1");
+		JsonWriterAddInt(&writer, "priority", i + 1);
+		JsonWriterAddString(&writer, "text", "Active");
+		JsonWriterObjectEnd(&writer);
+	}
+	JsonWriterArrayEnd(&writer);
+	JsonWriterObjectEnd(&writer);
+	return JsonWriterFinish(&writer);
+}
+
+ZTEST(json_writer, test_benchmark_against_cjson)
+{
+	static char cJsonBuffer[sizeof(buffer)];
+	cJSON_Hooks hooks = {.malloc_fn = CountingMalloc, .free_fn = CountingFree};
+	uint32_t cJsonCycles;
+	uint32_t writerCycles;
+	uint32_t start;
+	int cJsonLength = 0;
+	int writerLength = 0;
+
+	cJSON_InitHooks(&hooks);
+
+	start = k_cycle_get_32();
+	for (int i = 0; i < BENCHMARK_ROUNDS; i++)
+	{
+		cJsonLength = BuildWithCJson(cJsonBuffer, sizeof(cJsonBuffer));
+	}
+	cJsonCycles = (k_cycle_get_32() - start) / BENCHMARK_ROUNDS;
+	zassert_true(cJsonLength > 0, "cJSON failed (%d)", cJsonLength);
+	zassert_equal(heapInUse, 0, "cJSON leaked %d bytes", heapInUse);
+
+	//The writer must not touch the heap at all
+	heapPeak = 0;
+	heapAllocations = 0;
+	start = k_cycle_get_32();
+	for (int i = 0; i < BENCHMARK_ROUNDS; i++)
+	{
+		writerLength = BuildWithWriter(buffer, sizeof(buffer));
+	}
+	writerCycles = (k_cycle_get_32() - start) / BENCHMARK_ROUNDS;
+	zassert_equal(heapAllocations, 0, "The writer used the heap");
+
+	zassert_equal(writerLength, cJsonLength, "Different output length");
+	zassert_str_equal(buffer, cJsonBuffer);
+
+	//The cJSON heap use is for one round
+	heapPeak = 0;
+	heapAllocations = 0;
+	(void)BuildWithCJson(cJsonBuffer, sizeof(cJsonBuffer));
+	TC_PRINT("cJSON:  %d bytes, %u cycles, peak heap %u bytes in %u allocations\n",
+		cJsonLength, cJsonCycles, (unsigned int)heapPeak, heapAllocations);
+	TC_PRINT("writer: %d bytes, %u cycles, peak heap 0 bytes\n", writerLength, writerCycles);
+
+	cJSON_InitHooks(NULL);
+}
+
+ZTEST_SUITE(json_writer, NULL, NULL, NULL, NULL, NULL);
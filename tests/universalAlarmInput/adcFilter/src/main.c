@@ -0,0 +1,133 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <zephyr/kernel.h>
+#include <zephyr/ztest.h>
+
+#include "adcFilter.h"
+
+#define BASELINE 100
+#define STEP 1100
+#define SETTLE_SAMPLES 32 //More than the slowest filter needs to settle on the baseline
+#define MAX_LATENCY 64
+
+static AdcFilter filter;
+
+//Feed a constant value until the filter has settled on it
+static void settle(AdcFilter *pFilter, int16_t value)
+{
+	int16_t output = 0;
+
+	for (int i = 0; i < SETTLE_SAMPLES; i++)
+	{
+		output = AdcFilterUpdate(pFilter, value);
+	}
+	zassert_equal(output, value, "Filter didn't settle on %d", value);
+}
+
+//Samples after a step until the output is within the tolerance of the new value
+static int stepLatency(AdcFilter *pFilter, int16_t tolerance)
+{
+	settle(pFilter, BASELINE);
+
+	for (int i = 1; i <= MAX_LATENCY; i++)
+	{
+		if (abs(AdcFilterUpdate(pFilter, STEP) - STEP) <= tolerance)
+		{
+			return i;
+		}
+	}
+	return -1;
+}
+
+//Feed the trace after the baseline and compare every output
+static void checkTrace(AdcFilter *pFilter, const int16_t *pTrace, const int16_t *pExpected, size_t len)
+{
+	settle(pFilter, BASELINE);
+
+	for (size_t i = 0; i < len; i++)
+	{
+		zassert_equal(AdcFilterUpdate(pFilter, pTrace[i]), pExpected[i], "Output %d differs", (int)i);
+	}
+}
+
+ZTEST(adc_filter, test_init_rejects_invalid_length)
+{
+	zassert_equal(AdcFilterInit(&filter, ADC_FILTER_MOVING_AVERAGE, 0), -EINVAL);
+	zassert_equal(AdcFilterInit(&filter, ADC_FILTER_MEDIAN, ADC_FILTER_MAX_LENGTH + 1), -EINVAL);
+	zassert_equal(AdcFilterInit(&filter, ADC_FILTER_IIR, ADC_FILTER_IIR_MAX_SHIFT + 1), -EINVAL);
+	zassert_equal(filter.type, ADC_FILTER_NONE, "Rejected filter not disabled");
+
+	//A disabled filter passes the samples through
+	zassert_equal(AdcFilterUpdate(&filter, STEP), STEP);
+
+	zassert_equal(AdcFilterInit(&filter, ADC_FILTER_MEDIAN, ADC_FILTER_MAX_LENGTH), 0);
+	zassert_equal(AdcFilterInit(&filter, ADC_FILTER_IIR, ADC_FILTER_IIR_MAX_SHIFT), 0);
+}
+
+ZTEST(adc_filter, test_moving_average)
+{
+	static const int16_t step[] = {STEP, STEP, STEP, STEP, STEP};
+	static const int16_t stepExpected[] = {350, 600, 850, STEP, STEP};
+	static const int16_t glitch[] = {STEP, BASELINE, BASELINE, BASELINE, BASELINE};
+	static const int16_t glitchExpected[] = {350, 350, 350, 350, BASELINE};
+
+	zassert_equal(AdcFilterInit(&filter, ADC_FILTER_MOVING_AVERAGE, 4), 0);
+	checkTrace(&filter, step, stepExpected, ARRAY_SIZE(step));
+
+	//The glitch is spread over the window instead of being removed
+	checkTrace(&filter, glitch, glitchExpected, ARRAY_SIZE(glitch));
+
+	AdcFilterReset(&filter);
+	zassert_equal(stepLatency(&filter, 0), 4, "Step must be reached after the window length");
+
+	zassert_equal(AdcFilterInit(&filter, ADC_FILTER_MOVING_AVERAGE, ADC_FILTER_MAX_LENGTH), 0);
+	zassert_equal(stepLatency(&filter, 0), ADC_FILTER_MAX_LENGTH);
+}
+
+ZTEST(adc_filter, test_median)
+{
+	static const int16_t step[] = {STEP, STEP, STEP, STEP};
+	static const int16_t stepExpected[] = {BASELINE, BASELINE, STEP, STEP};
+	static const int16_t glitch[] = {STEP, BASELINE, BASELINE, BASELINE, BASELINE, BASELINE};
+	static const int16_t glitchExpected[] = {BASELINE, BASELINE, BASELINE, BASELINE, BASELINE, BASELINE};
+
+	zassert_equal(AdcFilterInit(&filter, ADC_FILTER_MEDIAN, 5), 0);
+	checkTrace(&filter, step, stepExpected, ARRAY_SIZE(step));
+
+	//A single sample glitch never reaches the output
+	AdcFilterReset(&filter);
+	checkTrace(&filter, glitch, glitchExpected, ARRAY_SIZE(glitch));
+
+	//A step passes once it is the majority of the window
+	AdcFilterReset(&filter);
+	zassert_equal(stepLatency(&filter, 0), 3);
+
+	zassert_equal(AdcFilterInit(&filter, ADC_FILTER_MEDIAN, 4), 0);
+	zassert_equal(stepLatency(&filter, 0), 3, "Even window must average the middle samples first");
+}
+
+ZTEST(adc_filter, test_iir)
+{
+	static const int16_t step[] = {STEP, STEP, STEP, STEP};
+	static const int16_t stepExpected[] = {350, 538, 678, 784};
+	static const int16_t glitch[] = {STEP, BASELINE, BASELINE, BASELINE};
+	static const int16_t glitchExpected[] = {350, 288, 241, 205};
+
+	zassert_equal(AdcFilterInit(&filter, ADC_FILTER_IIR, 2), 0);
+	checkTrace(&filter, step, stepExpected, ARRAY_SIZE(step));
+
+	AdcFilterReset(&filter);
+	checkTrace(&filter, glitch, glitchExpected, ARRAY_SIZE(glitch));
+
+	//The error shrinks by 3/4 per sample, 1000 * (3/4)^16 = 10.02 rounds into the 1% band.
+	//The fraction bits then let it settle exactly on the step
+	AdcFilterReset(&filter);
+	zassert_equal(stepLatency(&filter, (STEP - BASELINE) / 100), 16);
+	settle(&filter, STEP);
+
+	//The first sample after a reset starts the filter instead of ramping up from zero
+	AdcFilterReset(&filter);
+	zassert_equal(AdcFilterUpdate(&filter, STEP), STEP);
+}
+
+ZTEST_SUITE(adc_filter, NULL, NULL, NULL, NULL, NULL);